@@ -59,6 +59,8 @@ public:
 
     bool getWatcherLimits(int64_t &watchedNow, int64_t &watchLimit);
 
+    int64_t getWatcherUserWatchCount();
+
     void onScanUpdate();
 
     bool canRefresh();
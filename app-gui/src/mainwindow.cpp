@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <algorithm>
 #include <QtWidgets>
 
 #include "mainwindow.h"
@@ -98,6 +99,10 @@ void MainWindow::onScanUpdate() {
         spaceWidget->getWatcherLimits(watchedNow, watchLimit);
         int64_t dirCount = spaceWidget->getScannedDirs();
         auto newLimit = watchLimit + dirCount - watchedNow + 2048; // add some extra
+        // watches of other processes of user also count towards limit
+        auto userWatchCount = spaceWidget->getWatcherUserWatchCount();
+        if (userWatchCount >= 0)
+            newLimit = std::max(watchLimit, userWatchCount + dirCount - watchedNow + 2048);
         watchLimitReported = true;
         watchLimitExceeded = false;
         //TODO add option to hide these messages
@@ -270,6 +270,13 @@ bool SpaceView::getWatcherLimits(int64_t &watchedNow, int64_t &watchLimit) {
     return scanner->getWatcherLimits(watchedNow, watchLimit);
 }
 
+int64_t SpaceView::getWatcherUserWatchCount() {
+    if (!scanner)
+        return -1;
+
+    return scanner->getWatcherUserWatchCount();
+}
+
 bool SpaceView::isAtRoot() {
     if (!scanner)
         return true;
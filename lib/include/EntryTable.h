@@ -0,0 +1,142 @@
+#ifndef SPACEDISPLAY_ENTRY_TABLE_H
+#define SPACEDISPLAY_ENTRY_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Table of objects of the same size that are referenced by 32-bit indices
+ * instead of 64-bit pointers.
+ * Objects are stored in big chunks, aligned to their size, so index of object
+ * can be found from its pointer and pointer can be found from index with
+ * one lookup in table of chunks. Objects never move while they are allocated.
+ * Freed slots are reused by the next allocations and chunks that become empty
+ * are returned to the system.
+ * All functions are thread-safe, get() doesn't lock anything.
+ */
+class EntryTable {
+public:
+    /**
+     * Reference that never points to any object
+     */
+    static const uint32_t nullRef = 0;
+
+    /**
+     * All references are smaller than this value, so higher bit can be used by caller
+     */
+    static const uint32_t maxRef = 1u << 31u;
+
+    /**
+     * @param objectSize - size of each object (not bigger than 1024 bytes)
+     */
+    explicit EntryTable(size_t objectSize);
+
+    ~EntryTable();
+
+    EntryTable(const EntryTable &) = delete;
+
+    EntryTable &operator=(const EntryTable &) = delete;
+
+    /**
+     * Allocates memory for one object
+     * @param ref - where to store reference to allocated object
+     * @return pointer to allocated memory (aligned to 8 bytes)
+     * @throws std::bad_alloc if memory can't be allocated or table is full
+     */
+    void *allocate(uint32_t &ref);
+
+    /**
+     * Returns memory, previously allocated with allocate()
+     * @param ptr
+     */
+    void deallocate(void *ptr);
+
+    /**
+     * @param ref - reference of allocated object
+     * @return pointer to object
+     */
+    void *get(uint32_t ref) const {
+        auto chunk = chunks[ref >> SLOT_BITS].load(std::memory_order_acquire);
+        return reinterpret_cast<char *>(chunk) + CHUNK_HEADER_SIZE + (ref & SLOT_MASK) * objectSize;
+    }
+
+    /**
+     * @param ptr - pointer returned by allocate()
+     * @return reference to object
+     */
+    uint32_t getRef(const void *ptr) const;
+
+    /**
+     * @return number of currently allocated objects
+     */
+    int64_t getObjectCount() const;
+
+    /**
+     * @return total number of bytes currently reserved by all chunks
+     */
+    int64_t getReservedSize() const;
+
+private:
+    // chunks are aligned to their size, so chunk of any object can be found from its pointer
+    static const size_t CHUNK_SIZE = 1024 * 1024;
+    static const size_t CHUNK_HEADER_SIZE = 64;
+    static const unsigned SLOT_BITS = 15;
+    static const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+    static const size_t MAX_CHUNKS = size_t(maxRef) >> SLOT_BITS;
+    // each table is split into shards so threads don't fight for the same mutex
+    static const size_t SHARD_COUNT = 8;
+
+    struct Shard;
+
+    /**
+     * Header of chunk. Objects are stored right after it.
+     */
+    struct Chunk {
+        Shard *shard;
+        // chunk is in the list of shard only when it has free slots
+        Chunk *prev;
+        Chunk *next;
+        bool isListed;
+        uint32_t index;
+        // singly linked list of freed slots (index of next slot is stored inside slot)
+        uint32_t freeSlot;
+        // slots after this number were never used, so they are not in free list
+        uint32_t bumpedCount;
+        uint32_t usedCount;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        // list of chunks that have free slots
+        Chunk *partialChunks = nullptr;
+        size_t partialCount = 0;
+    };
+
+    const size_t objectSize;
+    const uint32_t chunkCapacity;
+
+    std::unique_ptr<std::atomic<Chunk *>[]> chunks;
+    Shard shards[SHARD_COUNT];
+
+    // protects indices of chunks
+    std::mutex chunksMtx;
+    std::vector<uint32_t> freeChunkIndices;
+    uint32_t nextChunkIndex;
+
+    std::atomic<int64_t> objectCount;
+    std::atomic<int64_t> reservedSize;
+
+    Chunk *createChunk(Shard &shard);
+
+    void freeChunk(Chunk *chunk);
+
+    static void listChunk(Shard &shard, Chunk *chunk);
+
+    static void unlistChunk(Shard &shard, Chunk *chunk);
+};
+
+#endif //SPACEDISPLAY_ENTRY_TABLE_H
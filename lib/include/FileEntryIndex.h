@@ -0,0 +1,89 @@
+#ifndef SPACEDISPLAY_FILE_ENTRY_INDEX_H
+#define SPACEDISPLAY_FILE_ENTRY_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FileEntry;
+
+/**
+ * Flat hash table (open addressing with linear probing) that finds entry
+ * by its parent and name.
+ * Each slot keeps 64-bit hash of (parent, name) pair so almost all probes
+ * that don't match are rejected without touching entry itself.
+ * Entries are not owned by index, they should be removed from it before they are destroyed.
+ * Index is not thread-safe.
+ */
+class FileEntryIndex {
+public:
+    FileEntryIndex();
+
+    /**
+     * Calculates 64-bit hash of name (MurmurHash64A)
+     * @param name
+     * @param length - length of name without null-terminator
+     * @return
+     */
+    static uint64_t hashName(const char *name, size_t length);
+
+    /**
+     * Finds child of given parent with given name
+     * @param parent
+     * @param name - name of entry (doesn't have to be null-terminated)
+     * @param length - length of name
+     * @return pointer to entry if it was found, nullptr otherwise
+     */
+    FileEntry *find(const FileEntry *parent, const char *name, size_t length) const;
+
+    /**
+     * Finds child of given parent with name that has given id in NamePool.
+     * Names are compared only by their ids, so this is faster than search by name.
+     * @param parent
+     * @param nameId
+     * @return pointer to entry if it was found, nullptr otherwise
+     */
+    FileEntry *find(const FileEntry *parent, uint32_t nameId) const;
+
+    /**
+     * Adds entry to index. Entry must already be added to its parent
+     * and should not be in index already.
+     * @param entry
+     */
+    void insert(FileEntry *entry);
+
+    /**
+     * Removes entry from index
+     * @param entry
+     * @return true if entry was in index
+     */
+    bool remove(const FileEntry *entry);
+
+    size_t size() const;
+
+    /**
+     * Prepares index to hold given number of entries without growing
+     * @param entryCount
+     */
+    void reserve(size_t entryCount);
+
+private:
+    struct Slot {
+        uint64_t hash;
+        FileEntry *entry;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t count;
+
+    static uint64_t slotHash(const FileEntry *parent, uint64_t nameHash);
+
+    /**
+     * Changes number of slots (must be power of two) and reinserts all entries
+     */
+    void rehash(size_t slotCount);
+};
+
+
+#endif //SPACEDISPLAY_FILE_ENTRY_INDEX_H
@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <cstdint>
 
 class FileIterator {
 protected:
@@ -19,6 +20,14 @@ public:
      */
     static std::unique_ptr<FileIterator> create(const std::string &path);
 
+    /**
+     * Allows iterators to stat many files at once with asynchronous requests (io_uring on Linux).
+     * Enabled by default. If it is disabled or not supported by platform (or build),
+     * files are stat'ed one by one. Results are the same in both cases.
+     * @param enabled
+     */
+    static void setAsyncStatEnabled(bool enabled);
+
     // can't copy
     FileIterator(const FileIterator &) = delete;
 
@@ -53,6 +62,29 @@ public:
      */
     virtual int64_t getSize() const = 0;
 
+    /**
+     * Platforms that don't report allocated size return the same value as getSize()
+     * @return space allocated on disk for current file, 0 for directories
+     * @throws std:out_of_range if iterator was not valid
+     */
+    virtual int64_t getAllocatedSize() const {
+        return getSize();
+    }
+
+    /**
+     * Gets id of current file if it has more than one hard link,
+     * so all its links can be detected
+     * Platforms that don't report number of links always return false
+     * @param device - where to store id of device where file is stored
+     * @param inode - where to store id of file on its device
+     * @return true if current file has more than one hard link
+     * @throws std:out_of_range if iterator was not valid
+     */
+    virtual bool getHardLinkId(uint64_t &/*device*/, uint64_t &/*inode*/) const {
+        assertValid();
+        return false;
+    }
+
     /**
      * Assert that this iterator is valid, otherwise throw an error
      * @throws std::out_of_range if iterator not valid
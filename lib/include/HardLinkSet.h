@@ -0,0 +1,103 @@
+#ifndef SPACEDISPLAY_HARD_LINK_SET_H
+#define SPACEDISPLAY_HARD_LINK_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Set of files with multiple hard links, so size of each such file is counted only once.
+ * File is identified by 64-bit hash of its device and inode, for each file set remembers
+ * which link is its owner (the first link that was found). Only owner link has size.
+ * Set is split into shards with their own locks, so it can be used by many threads at once.
+ * When owner link is removed, file is released and the next found link becomes its owner.
+ * The number of entries is limited, when set is full new files are not added
+ * and all their links are counted.
+ */
+class HardLinkSet {
+public:
+    static const size_t DEFAULT_MAX_ENTRIES = 1u << 22u;
+
+    explicit HardLinkSet(size_t maxEntries = DEFAULT_MAX_ENTRIES);
+
+    HardLinkSet(const HardLinkSet &) = delete;
+
+    HardLinkSet &operator=(const HardLinkSet &) = delete;
+
+    /**
+     * Registers link of file with given id.
+     * @param device - device of file
+     * @param inode - inode of file
+     * @param owner - id of this link (e.g. hash of its path), should be the same between scans
+     * @param linkDir - path to directory of this link, it is returned by release() when
+     *        owner of file is removed, so directory can be scanned again and link becomes owner
+     * @return true if size of file should be counted for this link: it is the first link
+     *         of this file, it is the same link that was found first or set is full
+     */
+    bool claim(uint64_t device, uint64_t inode, uint32_t owner,
+               const std::string &linkDir = std::string());
+
+    /**
+     * Releases all files that are owned by given link, so they can be claimed by other links
+     * @param owner - id of removed link
+     * @param linkDirs - where to add directories of links that were not counted because
+     *        of this owner, they should be scanned again to count released files
+     */
+    void release(uint32_t owner, std::vector<std::string> &linkDirs);
+
+    /**
+     * Removes all entries, so links are claimed again by the next scan
+     */
+    void clear();
+
+    size_t size() const;
+
+    /**
+     * Faster than checking size(), shards are not locked
+     * @return true if set has no files
+     */
+    bool empty() const;
+
+private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct Slot {
+        // 0 if slot is empty
+        uint64_t key;
+        uint32_t owner;
+    };
+
+    struct Shard {
+        mutable std::mutex mtx;
+        std::vector<Slot> slots;
+        size_t count = 0;
+    };
+
+    Shard shards[SHARD_COUNT];
+    size_t maxShardEntries;
+
+    // owners are looked up only when links are removed, so they are stored separately
+    mutable std::mutex ownersMtx;
+    std::unordered_multimap<uint32_t, uint64_t> ownedKeys;
+    // directory of the last link that was not counted, stored for each file key
+    std::unordered_map<uint64_t, std::string> waitingDirs;
+
+    static uint64_t hashId(uint64_t device, uint64_t inode);
+
+    /**
+     * Doubles number of slots in shard and reinserts all entries
+     */
+    static void grow(Shard &shard);
+
+    /**
+     * Removes entry from shard if it is owned by given link
+     * @return true if entry was removed
+     */
+    static bool removeOwned(Shard &shard, uint64_t key, uint32_t owner);
+};
+
+
+#endif //SPACEDISPLAY_HARD_LINK_SET_H
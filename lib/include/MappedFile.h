@@ -0,0 +1,37 @@
+#ifndef SPACEDISPLAY_MAPPED_FILE_H
+#define SPACEDISPLAY_MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Read-only memory mapping of the whole file.
+ * Pages are loaded by the system only when they are accessed,
+ * so opening even a huge file is instant.
+ */
+class MappedFile {
+public:
+    /**
+     * Maps file at the given path to memory
+     * @param path
+     * @throws std::runtime_error if file can't be opened or mapped
+     */
+    explicit MappedFile(const std::string &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const;
+
+    size_t size() const;
+
+private:
+    const uint8_t *ptr;
+    size_t length;
+};
+
+#endif //SPACEDISPLAY_MAPPED_FILE_H
@@ -0,0 +1,72 @@
+#ifndef SPACEDISPLAY_NAME_POOL_H
+#define SPACEDISPLAY_NAME_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Pool of interned names of file entries.
+ * The same names (e.g. ".git", "index.js", "LICENSE") appear in trees many times,
+ * so each distinct name is stored only once and entries reference it by 32-bit id.
+ * Two names are equal only if their ids are equal, so names can be compared without
+ * looking at their characters.
+ * Names are reference counted and are freed when the last reference is released,
+ * ids of freed names are reused.
+ * All functions are thread-safe. Name returned by getName() is valid while its id
+ * is referenced and can be read without any locks.
+ */
+namespace NamePool {
+    /**
+     * Id that never references any name
+     */
+    const uint32_t invalidId = 0;
+
+    /**
+     * Finds name in pool or adds it if it is not there yet and adds reference to it
+     * @param name - name (doesn't have to be null-terminated)
+     * @param length - length of name
+     * @return id of name
+     * @throws std::bad_alloc if pool is full or memory can't be allocated
+     */
+    uint32_t acquire(const char *name, size_t length);
+
+    /**
+     * Removes reference to name, previously added with acquire().
+     * Name is freed when there are no references to it.
+     * @param id
+     */
+    void release(uint32_t id);
+
+    /**
+     * Finds id of name without adding reference to it
+     * @param name - name (doesn't have to be null-terminated)
+     * @param length - length of name
+     * @return id of name or invalidId if there is no such name in pool
+     */
+    uint32_t find(const char *name, size_t length);
+
+    /**
+     * @param id
+     * @return null-terminated name
+     */
+    const char *getName(uint32_t id);
+
+    /**
+     * @param id
+     * @return length of name without null-terminator
+     */
+    size_t getLength(uint32_t id);
+
+    /**
+     * @param id
+     * @return hash of name, the same as FileEntryIndex::hashName() returns for it
+     */
+    uint64_t getHash(uint32_t id);
+
+    /**
+     * @return number of distinct names currently in pool
+     */
+    size_t getNameCount();
+}
+
+#endif //SPACEDISPLAY_NAME_POOL_H
@@ -0,0 +1,97 @@
+#ifndef SPACEDISPLAY_SCAN_QUEUE_H
+#define SPACEDISPLAY_SCAN_QUEUE_H
+
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+
+class FilePath;
+
+/**
+ * Queue of scan requests that is indexed by path prefix trie.
+ * Each queued path is stored at its own trie node, so finding duplicates,
+ * queued ancestors and queued descendants only walks along the path
+ * (and subtree of queued descendants), not the whole queue.
+ * Queue is not thread-safe.
+ */
+class ScanQueue {
+public:
+    struct Request {
+        std::unique_ptr<FilePath> path;
+        bool recursive;
+        // if true, directory is not listed again when its stamp didn't change
+        bool quick;
+    };
+
+    ScanQueue();
+
+    ~ScanQueue();
+
+    ScanQueue(const ScanQueue &) = delete;
+
+    ScanQueue &operator=(const ScanQueue &) = delete;
+
+    /**
+     * Adds request to queue (to the back or to the front).
+     * If the same path is already queued, requests are merged and moved to new place.
+     * If request is recursive, all queued requests for paths inside it are removed.
+     * If any parent path is already queued recursively, request is not added since
+     * it will be scanned anyway.
+     * Quick requests never replace full requests, since they might skip some changes.
+     * @param path
+     * @param recursive
+     * @param quick
+     * @param toBack
+     */
+    void push(std::unique_ptr<FilePath> path, bool recursive, bool quick, bool toBack = true);
+
+    /**
+     * Takes request from the front of the queue
+     * @param request - where to store request
+     * @return false if queue is empty
+     */
+    bool pop(Request &request);
+
+    void clear();
+
+    bool empty() const;
+
+    size_t size() const;
+
+private:
+    struct Node {
+        Node *parent = nullptr;
+        // part of path that this node represents
+        std::string name;
+        std::unordered_map<std::string, std::unique_ptr<Node>> children;
+
+        // valid only if node is queued
+        bool isQueued = false;
+        Request request;
+        std::list<Node *>::iterator orderIt;
+    };
+
+    Node root;
+    // queued nodes in order of processing
+    std::list<Node *> order;
+
+    /**
+     * Removes request of node from queue (node itself is not deleted)
+     */
+    void unqueue(Node &node);
+
+    /**
+     * Removes queued requests of all descendants of node that can be replaced by recursive request
+     * Empty nodes are deleted
+     */
+    void removeDescendants(Node &node, bool quick);
+
+    /**
+     * Deletes node and its parents while they are empty
+     */
+    void prune(Node *node);
+};
+
+
+#endif //SPACEDISPLAY_SCAN_QUEUE_H
@@ -0,0 +1,69 @@
+#ifndef SPACEDISPLAY_SHARED_MUTEX_H
+#define SPACEDISPLAY_SHARED_MUTEX_H
+
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Reader/writer mutex (std::shared_mutex is not available in C++11).
+ * Any number of readers can hold it at the same time, writer holds it exclusively.
+ * Waiting writers have priority over new readers, so a constant stream
+ * of readers can't starve a writer.
+ * Exclusive functions follow Lockable requirements so std::lock_guard
+ * and std::unique_lock can be used, for shared access use SharedLock.
+ */
+class SharedMutex {
+public:
+    SharedMutex();
+
+    SharedMutex(const SharedMutex &) = delete;
+
+    SharedMutex &operator=(const SharedMutex &) = delete;
+
+    void lock();
+
+    /**
+     * Locks mutex exclusively only if it is not held by anyone and no other writer waits for it
+     * @return true if mutex was locked
+     */
+    bool try_lock();
+
+    void unlock();
+
+    void lock_shared();
+
+    void unlock_shared();
+
+private:
+    std::mutex mtx;
+    std::condition_variable readersCv;
+    std::condition_variable writersCv;
+
+    int activeReaders;
+    int waitingWriters;
+    bool hasWriter;
+};
+
+/**
+ * Holds shared (read) access to SharedMutex while in scope
+ */
+class SharedLock {
+public:
+    explicit SharedLock(SharedMutex &mutex) : mtx(mutex) {
+        mtx.lock_shared();
+    }
+
+    ~SharedLock() {
+        mtx.unlock_shared();
+    }
+
+    SharedLock(const SharedLock &) = delete;
+
+    SharedLock &operator=(const SharedLock &) = delete;
+
+private:
+    SharedMutex &mtx;
+};
+
+
+#endif //SPACEDISPLAY_SHARED_MUTEX_H
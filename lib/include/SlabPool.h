@@ -0,0 +1,85 @@
+#ifndef SPACEDISPLAY_SLAB_POOL_H
+#define SPACEDISPLAY_SLAB_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/**
+ * Allocator for a large number of small objects (file entries, their names
+ * and nodes of containers that hold them).
+ * Objects are grouped by size classes (multiples of 8 bytes) and each class
+ * is served from big aligned slabs, so there is no per-object malloc overhead
+ * and objects of the same type are packed together in memory.
+ * Freed objects are reused by the next allocations of the same size class and
+ * slabs that become empty are returned to the system.
+ * Allocations bigger than maxSlabObjectSize are forwarded to operator new.
+ * All functions are thread-safe.
+ */
+namespace SlabPool {
+    /**
+     * Objects up to this size are allocated inside slabs
+     */
+    const size_t maxSlabObjectSize = 256;
+
+    /**
+     * Allocates memory for object of given size
+     * @param size
+     * @return pointer to allocated memory (aligned to 8 bytes)
+     * @throws std::bad_alloc if memory can't be allocated
+     */
+    void *allocate(size_t size);
+
+    /**
+     * Returns memory, previously allocated with allocate()
+     * @param ptr - pointer returned by allocate()
+     * @param size - the same size that was passed to allocate()
+     */
+    void deallocate(void *ptr, size_t size);
+
+    /**
+     * @return total number of bytes currently reserved by all slabs
+     */
+    int64_t getReservedSize();
+
+    /**
+     * @return number of bytes currently allocated by objects in slabs
+     */
+    int64_t getUsedSize();
+}
+
+/**
+ * Standard allocator that can be used with node based containers (e.g. std::set)
+ * so their nodes are allocated with SlabPool
+ * @tparam T
+ */
+template<class T>
+struct SlabAllocator {
+    typedef T value_type;
+
+    SlabAllocator() = default;
+
+    template<class U>
+    SlabAllocator(const SlabAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(SlabPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        SlabPool::deallocate(p, n * sizeof(T));
+    }
+
+    template<class U>
+    struct rebind {
+        typedef SlabAllocator<U> other;
+    };
+};
+
+template<class T, class U>
+bool operator==(const SlabAllocator<T> &, const SlabAllocator<U> &) { return true; }
+
+template<class T, class U>
+bool operator!=(const SlabAllocator<T> &, const SlabAllocator<U> &) { return false; }
+
+#endif //SPACEDISPLAY_SLAB_POOL_H
@@ -0,0 +1,110 @@
+#ifndef SPACEDISPLAY_SPILL_FILE_H
+#define SPACEDISPLAY_SPILL_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+class MappedFile;
+
+/**
+ * File for data that doesn't fit in memory.
+ * Data is written to the smallest released range that can hold it or at the end of file
+ * and read back through memory mapping of the whole file, which is remapped only when
+ * data past its end is read or data inside of it is overwritten.
+ * File is created when spill file is constructed and removed when it is destroyed.
+ * All functions are thread-safe.
+ */
+class SpillFile {
+public:
+    /**
+     * Creates file at given path (existing file is truncated)
+     * @param path
+     * @throws std::runtime_error if file can't be created
+     */
+    explicit SpillFile(const std::string &path);
+
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+
+    SpillFile &operator=(const SpillFile &) = delete;
+
+    /**
+     * Writes data to released range or at the end of file
+     * @param data
+     * @param size
+     * @return offset of written data in file
+     * @throws std::runtime_error if data can't be written
+     */
+    uint64_t write(const void *data, size_t size);
+
+    /**
+     * Marks previously written data as not needed, so its range can be reused
+     * @param offset - offset returned by write()
+     * @param size - size of written data
+     */
+    void release(uint64_t offset, size_t size);
+
+    /**
+     * Copies previously written data
+     * @param offset - offset returned by write()
+     * @param dest - where to copy data
+     * @param size - how many bytes to copy
+     * @return false if range is outside of written data or file can't be mapped
+     */
+    bool read(uint64_t offset, void *dest, size_t size);
+
+    /**
+     * Passes pointer to previously written data inside of file mapping to reader,
+     * so data doesn't have to be copied. Pointer is valid only until reader returns,
+     * reader must not call other functions of this file.
+     * @param offset - offset returned by write()
+     * @param size - size of data
+     * @param reader
+     * @return false if range is outside of written data or file can't be mapped
+     */
+    bool view(uint64_t offset, size_t size, const std::function<void(const char *)> &reader);
+
+    /**
+     * @return size of file in bytes
+     */
+    uint64_t size() const;
+
+    /**
+     * @return number of bytes in released ranges
+     */
+    uint64_t releasedSize() const;
+
+private:
+    const std::string path;
+
+    mutable std::mutex mtx;
+    std::ofstream file;
+    uint64_t fileSize;
+    std::unique_ptr<MappedFile> mapped;
+
+    // released ranges by their offset (adjacent ranges are merged) and by their size
+    std::map<uint64_t, uint64_t> releasedByOffset;
+    std::set<std::pair<uint64_t, uint64_t>> releasedBySize;
+    uint64_t releasedBytes;
+
+    void addReleased(uint64_t offset, uint64_t size);
+
+    /**
+     * Makes sure that mapping covers given range, file should be locked
+     * @return false if range is outside of written data or file can't be mapped
+     */
+    bool mapRange(uint64_t offset, size_t size);
+
+    void removeReleased(std::map<uint64_t, uint64_t>::iterator it);
+};
+
+#endif //SPACEDISPLAY_SPILL_FILE_H
@@ -4,21 +4,109 @@
 #include <vector>
 #include <memory>
 #include <functional>
-#include <mutex>
 #include <atomic>
 #include <unordered_map>
+#include <unordered_set>
+
+#include "FileEntryIndex.h"
+#include "SharedMutex.h"
+#include "platformutils.h"
 
 class FileEntry;
 
 class FilePath;
 
+class SpillFile;
+
+/**
+ * Which size of files is stored in db
+ */
+enum class SizeMode {
+    // size of file content (st_size)
+    APPARENT,
+    // space that is allocated for file on disk (st_blocks on linux)
+    ON_DISK,
+};
+
 /**
  * Implements tree structure for files/directories
  * Also can store information about total and available space
+ * Db can be read by many threads at once (findEntry, processEntry),
+ * while changes are applied exclusively
+ * If memory budget is set, children of big subtrees might be moved to spill file,
+ * they are loaded back when path inside of such subtree is accessed
  */
 class FileDB {
 public:
-    explicit FileDB(const std::string &path);
+    /**
+     * Totals of directory subtree whose entries are not stored in db
+     */
+    struct Aggregate {
+        int64_t size;
+        int64_t fileCount;
+        int64_t dirCount;
+    };
+
+    /**
+     * Children of a single path that should be set in db with setChildrenForPaths()
+     */
+    struct ChildrenUpdate {
+        ChildrenUpdate(std::unique_ptr<FilePath> path,
+                       std::vector<std::unique_ptr<FileEntry>> entries,
+                       bool collectNewPaths);
+
+        std::unique_ptr<FilePath> path;
+        std::vector<std::unique_ptr<FileEntry>> entries;
+        // if true, paths to newly added directories are added to newPaths
+        bool collectNewPaths;
+        std::vector<std::unique_ptr<FilePath>> newPaths;
+        // if true, paths to directories that were deleted are added to deletedPaths
+        // (only topmost ones, their subdirectories are deleted too)
+        bool collectDeletedPaths;
+        std::vector<std::unique_ptr<FilePath>> deletedPaths;
+        // if true, paths to all deleted files (including files inside of deleted directories)
+        // are added to deletedFiles, files of spilled and aggregated directories are not known
+        bool collectDeletedFiles;
+        std::vector<std::unique_ptr<FilePath>> deletedFiles;
+        // true if entries are already sorted by size
+        bool isSorted;
+        // stamp of directory taken before its entries were read
+        bool hasStamp;
+        PlatformUtils::DirStamp stamp;
+        // if true, entries are ignored, all children of directory are removed and
+        // directory gets total size of its subtree, files and dirs of subtree are counted by db
+        bool hasAggregate;
+        Aggregate aggregate;
+    };
+
+    explicit FileDB(const std::string &path, SizeMode sizeMode = SizeMode::APPARENT);
+
+    ~FileDB();
+
+    /**
+     * Limits memory that is used by entries of db. When estimated usage goes above budget,
+     * children of the biggest fully scanned subtrees (that are not direct children of root)
+     * are written to spill file and only total size of subtree is kept in memory.
+     * Spilled children are loaded back when path inside of subtree is accessed.
+     * Applied with the next change of db.
+     * @param bytes - memory budget, 0 to disable the limit
+     * @param spillPath - path to file where spilled entries are stored, it is only
+     * used when spill file is created the first time and removed when db is destroyed
+     * @return false if spill file can't be created
+     */
+    bool setMemoryBudget(int64_t bytes, const std::string &spillPath);
+
+    /**
+     * Estimated number of bytes used by entries that are currently in memory
+     * @return
+     */
+    int64_t getMemoryUsage() const;
+
+    /**
+     * Number of files and directories that are currently stored only in spill file
+     * @return
+     */
+    int64_t getSpilledCount() const;
 
     /**
      * Sets space of mount point where files in this db are stored
@@ -40,6 +128,31 @@ public:
                             std::vector<std::unique_ptr<FileEntry>> entries,
                             std::vector<std::unique_ptr<FilePath>> *newPaths = nullptr);
 
+    /**
+     * Same as setChildrenForPath() but sets children for all updates (in the given order)
+     * while db is locked only once.
+     * If wait is false and db is currently read or changed by someone else, nothing is
+     * changed and false is returned, so caller can continue its work and try again later.
+     * Entries of applied updates are consumed, paths to new directories are put
+     * into newPaths of corresponding update.
+     * @param updates
+     * @param wait - whether to wait until db can be changed
+     * @return true if updates were applied
+     */
+    bool setChildrenForPaths(std::vector<ChildrenUpdate> &updates, bool wait = true);
+
+    /**
+     * Checks whether directory at given path has the same stamp as the one that was stored
+     * when its children were set. If it is, then its children are still the same and
+     * paths to all child directories are added to childDirs.
+     * @param path
+     * @param stamp - current stamp of directory
+     * @param childDirs - where to add paths to child directories
+     * @return true if directory is known and its stamp didn't change
+     */
+    bool getChildDirsIfUnchanged(const FilePath &path, const PlatformUtils::DirStamp &stamp,
+                                 std::vector<std::unique_ptr<FilePath>> &childDirs) const;
+
     /**
      * Returns path to current root or null if db is not initialized
      * @return
@@ -53,10 +166,19 @@ public:
      */
     const FileEntry *findEntry(const FilePath &path) const;
 
+    /**
+     * Returns totals of directory whose children were replaced by aggregate
+     * @param path
+     * @param aggregate - where to store totals
+     * @return false if directory at path doesn't exist or doesn't have aggregate
+     */
+    bool getAggregate(const FilePath &path, Aggregate &aggregate) const;
+
     /**
      * Let's you access entry at arbitrary path
      * Data is safe to access only inside callback func, do not save it
-     * Database is locked during processing so don't spend much time
+     * Database is locked for reading during processing, other readers are not blocked,
+     * but changes have to wait, so don't spend much time
      * By processing root db assumes, you read all changes so hasChanges is set to false
      * If db is not initialized, func will not be called and false is returned
      * @param func
@@ -72,16 +194,46 @@ public:
 
     int64_t getDirCount() const;
 
+    /**
+     * Which size is stored for files in this db. It is only stored by db (and saved to
+     * snapshot), sizes should be provided in this mode by whoever fills the db.
+     * @return
+     */
+    SizeMode getSizeMode() const;
+
+    /**
+     * Saves whole tree to binary snapshot that can be loaded with loadSnapshot().
+     * Snapshot consists of header, all entries flattened in depth-first order,
+     * a table of their names, stamps of directories and totals of aggregated directories.
+     * Snapshot is written to temporary file first and then renamed, so existing
+     * snapshot is not corrupted if something goes wrong.
+     * Db is locked for reading while snapshot is written.
+     * @param snapshotPath
+     * @return true on success
+     */
+    bool saveSnapshot(const std::string &snapshotPath) const;
+
+    /**
+     * Loads db from snapshot created with saveSnapshot().
+     * Snapshot is mapped to memory so only pages with entries are read from disk.
+     * @param snapshotPath
+     * @return loaded db or nullptr if snapshot can't be read or it is not valid
+     */
+    static std::unique_ptr<FileDB> loadSnapshot(const std::string &snapshotPath);
+
 private:
 
-    int64_t totalSpace = 0;
-    int64_t availableSpace = 0;
+    std::atomic<int64_t> totalSpace;
+    std::atomic<int64_t> availableSpace;
+
+    SizeMode sizeMode;
 
-    mutable std::mutex dbMtx;
+    mutable SharedMutex dbMtx;
 
     std::atomic<int64_t> usedSpace;
     std::atomic<int64_t> fileCount;
     std::atomic<int64_t> dirCount;
+    mutable std::atomic<int64_t> spilledCount;
 
     //TODO make it possible to access "has changes" info by some caller id
     mutable std::atomic<bool> bHasChanges;
@@ -89,19 +241,149 @@ private:
     std::unique_ptr<FileEntry> rootFile;
     std::unique_ptr<FilePath> rootPath;
 
-    //map key is crc of entry path, map value is vector of all children with the same crc of their name
-    std::unordered_map<uint16_t, std::vector<FileEntry *>> entriesMap;
+    // spilled children are loaded back by readers too, so everything
+    // that is changed by loading is mutable (it is changed only under exclusive lock)
+
+    // index of all entries (except root) by their parent and name
+    mutable FileEntryIndex entriesIndex;
+
+    // stamps of directories at the moment their children were set
+    mutable std::unordered_map<const FileEntry *, PlatformUtils::DirStamp> dirStamps;
+
+    /**
+     * Location of children of spilled directory in spill file
+     */
+    struct SpilledDir {
+        uint64_t offset;
+        uint64_t blockSize;
+        uint64_t nodeCount;
+        uint64_t namesSize;
+        uint64_t stampCount;
+        uint32_t childCount;
+        int64_t fileCount;
+        int64_t dirCount;
+    };
+
+    // 0 if memory is not limited
+    int64_t memoryBudget;
+    // if not enough subtrees could be spilled, next attempt is made when usage reaches this value
+    int64_t nextSpillUsage;
+    std::unique_ptr<SpillFile> spillFile;
+    mutable std::unordered_map<const FileEntry *, SpilledDir> spilledDirs;
+    // directory that was loaded the last time, it is not spilled again until something else is loaded
+    mutable const FileEntry *recentlyLoaded;
+
+    // totals of directories that don't have children entries (they are not spilled)
+    std::unordered_map<const FileEntry *, Aggregate> aggregates;
+
+    // directories that were added, but their children were not set yet
+    // (tracked only when memory budget is set, such subtrees are not spilled)
+    std::unordered_set<const FileEntry *> pendingDirs;
+
+    // number of pending, aggregated and spilled directories in subtree of each directory
+    // (directories without such subtrees are not stored, tracked only when memory budget is set)
+    mutable std::unordered_map<const FileEntry *, int64_t> blockedDirs;
+    // the highest directories whose subtrees can be spilled and number of entries in them
+    // (-1 if subtree was changed since it was counted)
+    mutable std::unordered_map<const FileEntry *, int64_t> spillCandidates;
 
     FileEntry *_findEntry(const FilePath &path) const;
 
-    FileEntry *_findEntry(const char *entryName, uint16_t nameCrc, FileEntry *parent) const;
+    /**
+     * Finds child of parent by id of its name in NamePool
+     * @param nameId
+     * @param parent - parent entry, if nullptr, only root is checked
+     * @return
+     */
+    FileEntry *_findEntry(uint32_t nameId, FileEntry *parent) const;
 
     /**
-     * Deletes all items from entriesMap for this entry and all children (recursively)
+     * Deletes this entry and all children (recursively) from entriesIndex
      * Modifies global fileCount and dirCount by number of removed files and dirs
      * @param entry
      */
-    void _cleanupEntryCrc(const FileEntry &entry);
+    void _cleanupEntryIndex(const FileEntry &entry);
+
+    /**
+     * Sets children of entry at given path, db should be locked exclusively
+     * Entries should be sorted by size (in decreasing order)
+     * If stamp is not provided, stored stamp of directory is removed
+     * Paths to deleted child directories are added to deletedPaths (if not nullptr)
+     * Paths to all deleted files are added to deletedFiles (if not nullptr)
+     * If aggregate is provided, entries should be empty and directory gets aggregated size
+     */
+    bool _setChildrenForPath(const FilePath &path,
+                             std::vector<std::unique_ptr<FileEntry>> &entries,
+                             std::vector<std::unique_ptr<FilePath>> *newPaths,
+                             const PlatformUtils::DirStamp *stamp = nullptr,
+                             std::vector<std::unique_ptr<FilePath>> *deletedPaths = nullptr,
+                             const Aggregate *aggregate = nullptr,
+                             std::vector<std::unique_ptr<FilePath>> *deletedFiles = nullptr);
+
+    /**
+     * Finds the first spilled directory on given path (including entry at path itself)
+     * @param path
+     * @return spilled directory or nullptr if there is no such directory
+     */
+    FileEntry *_findSpilledEntry(const FilePath &path) const;
+
+    /**
+     * Loads children of all spilled directories on given path, db should be locked exclusively
+     * @param path
+     */
+    void _loadSpilledPath(const FilePath &path) const;
+
+    /**
+     * Same as _loadSpilledPath() but locks db by itself (db should not be locked)
+     * Only locks db exclusively if there is something to load
+     * @param path
+     */
+    void loadSpilledPath(const FilePath &path) const;
+
+    /**
+     * Loads children of spilled directory back to memory, db should be locked exclusively
+     * If spilled children can't be read, directory stays spilled
+     * @param entry
+     * @return true if children were loaded
+     */
+    bool _loadSpilledEntry(FileEntry *entry) const;
+
+    /**
+     * Forgets spilled children of entry (if it is spilled) and subtracts them from totals of db
+     * @param entry
+     * @return true if entry was spilled
+     */
+    bool _dropSpilledEntry(const FileEntry *entry);
+
+    /**
+     * Moves children of entry to spill file, db should be locked exclusively
+     * Subtree should not contain other spilled directories
+     * @param entry
+     * @return false if children can't be written to spill file
+     */
+    bool _spillEntry(FileEntry *entry);
+
+    /**
+     * Changes number of directories that prevent spilling of subtrees that contain entry
+     * When subtree doesn't have such directories anymore, it becomes spill candidate
+     * @param entry - directory that became (or stopped being) pending, aggregated or spilled
+     * @param delta - +1 or -1 or number of such directories in removed subtree
+     */
+    void _updateSpillBlockers(const FileEntry *entry, int64_t delta) const;
+
+    /**
+     * Makes spill candidates from all subtrees of existing tree,
+     * used when memory budget is set after tree is already built
+     */
+    void _collectSpillCandidates();
+
+    /**
+     * Spills the biggest subtrees until estimated memory usage is
+     * well below budget, db should be locked exclusively
+     */
+    void _spillIfNeeded();
+
+    static void sortEntries(std::vector<std::unique_ptr<FileEntry>> &entries);
 
 };
 
@@ -7,14 +7,16 @@
 #include <vector>
 #include <memory>
 #include <functional>
-#include <set>
-#include <unordered_map>
+
+#include "SlabPool.h"
 
 class FileEntry {
 public:
     /**
      * Constructs new FileEntry object.
      * Name must be non empty
+     * Entries that are created this way (e.g. on stack) are referenced
+     * through a separate slot in EntryTable that points to them.
      * @param name
      * @param isDir
      * @param size
@@ -22,10 +24,41 @@ public:
      */
     FileEntry(const std::string &name, bool isDir, int64_t size = 0);
 
+    /**
+     * Creates new FileEntry object in EntryTable.
+     * Entries are allocated in EntryTable since there might be millions of them,
+     * this way they can reference each other with 32-bit indices.
+     * Name must be non empty
+     * @param name
+     * @param isDir
+     * @param size
+     * @return created entry
+     * @throws std::invalid_argument if name is empty
+     */
+    static std::unique_ptr<FileEntry> create(const std::string &name, bool isDir, int64_t size = 0);
+
+    ~FileEntry();
+
+    FileEntry(const FileEntry &) = delete;
+
+    FileEntry &operator=(const FileEntry &) = delete;
+
+    /**
+     * Entries can only be allocated in EntryTable with create()
+     */
+    static void *operator new(size_t) = delete;
+
+    /**
+     * Returns memory of entry, that was created with create(), to EntryTable
+     * @param ptr
+     */
+    static void operator delete(void *ptr);
+
     /**
      * Sets new size for this entry.
      * If entry has a parent, this will be a slow operation
      * since parent will need to reorder this entry
+     * During batch update of children, parents are updated only when update is finished
      * @param newSize
      */
     void setSize(int64_t newSize);
@@ -34,12 +67,16 @@ public:
 
     const char *getName() const;
 
+    /**
+     * Entries with equal names have equal ids
+     * @return id of name in NamePool
+     */
+    uint32_t getNameId() const;
+
     const FileEntry *getParent() const;
 
     uint16_t getNameCrc() const;
 
-    uint16_t getPathCrc() const;
-
     /**
      * Executes provided function for each child until all children are processed
      * If function returns false, processing is stopped
@@ -55,6 +92,22 @@ public:
      */
     void addChild(std::unique_ptr<FileEntry> child);
 
+    /**
+     * Adds child without changing size of this entry and its parents.
+     * Used when tree is restored and sizes of all entries are already known.
+     * @param child
+     */
+    void restoreChild(std::unique_ptr<FileEntry> child);
+
+    /**
+     * Removes all children without changing size of this entry and its parents.
+     * Used when children are stored somewhere else and only their total size is kept.
+     * @param removedChildren - where to put removed children
+     */
+    void takeChildren(std::vector<std::unique_ptr<FileEntry>> &removedChildren);
+
+    size_t getChildCount() const;
+
     /**
      * Remove all children, that are marked for deletion
      * All removed children are put into provided vector
@@ -74,54 +127,92 @@ public:
      */
     void unmarkPendingDelete();
 
+    /**
+     * Starts batch update of children.
+     * Until endChildrenUpdate() is called, adding, removing and resizing children
+     * doesn't reorder them and doesn't change size of parents of this entry.
+     * Size of this entry itself is kept up to date.
+     * Batch updates can't be nested.
+     * @return size of this entry, it should be passed to endChildrenUpdate()
+     */
+    int64_t beginChildrenUpdate();
+
+    /**
+     * Finishes batch update of children: sorts them if needed and
+     * changes size of all parents once by total change of size.
+     * @param sizeBefore - value returned by beginChildrenUpdate()
+     */
+    void endChildrenUpdate(int64_t sizeBefore);
+
     bool isDir() const;
 
     bool isRoot() const;
 
 private:
 
+    /**
+     * Constructs entry that is referenced by ref
+     * @param ref - reference to memory of entry in EntryTable or EntryTable::nullRef
+     * if entry is not stored in table
+     */
+    FileEntry(uint32_t ref, const std::string &name, bool isDir, int64_t size);
+
     void _addChild(std::unique_ptr<FileEntry> child);
 
     void onChildSizeChanged(FileEntry *child, int64_t sizeChange);
 
     /**
-     * Recalculates crc of path to this entry given path crc of entry parent
-     * @param parentPathCrc
+     * Finds position of child in children array
+     * @param child
+     * @param childSize - size that is used to order this child (might be different from current size)
+     * @return index of child or childCount if it was not found
      */
-    void updatePathCrc(uint16_t parentPathCrc);
+    size_t findChild(const FileEntry *child, int64_t childSize) const;
 
-    struct EntryBin {
-        int64_t size;
-        // entries are in chain (all entries in chain have the same size)
-        // to access next one use firstEntry->next
-        std::unique_ptr<FileEntry> firstEntry;
+    /**
+     * Makes sure that children array can hold at least given number of children
+     * @param count
+     */
+    void reserveChildren(uint32_t count);
 
-        explicit EntryBin(int64_t size, std::unique_ptr<FileEntry> p = nullptr) :
-                size(size), firstEntry(std::move(p)) {}
+    /**
+     * Finds entry by its reference
+     * @param ref
+     * @return
+     */
+    static FileEntry *getEntry(uint32_t ref);
 
-        bool operator<(const EntryBin &right) const {
-            // use ordering in decreasing order
-            return size > right.size;
-        }
-    };
+    FileEntry *getChild(size_t index) const;
 
-    FileEntry *parent;
+    // entries reference each other with 32-bit indices in table of entries instead of pointers
+    // reference to parent, EntryTable::nullRef if entry doesn't have parent
+    uint32_t parentRef;
+    // reference to this entry, it is given to children as their parentRef
+    uint32_t selfRef;
 
-    //used only inside EntryBin to point to the next entry with the same size
-    std::unique_ptr<FileEntry> nextEntry;
-    std::set<EntryBin> children;
+    // references to children, sorted by size (in decreasing order)
+    // they are stored contiguously so they can be processed in order
+    // allocated with SlabPool
+    uint32_t *children;
+    uint32_t childCount;
+    uint32_t childCapacity;
 
-    //used to mark entry to delete in function removePendingDelete
-    bool pendingDelete;
+    int64_t size;
 
-    bool bIsDir;
+    //not storing name in entry to reduce memory consumption (there are might be millions of entries
+    //so each byte counts), the same names are shared between entries
+    uint32_t nameId;
     uint16_t nameCrc;
 
-    // path crc is xor of all names in path (without trailing slashes, except root)
-    uint16_t pathCrc;
-    int64_t size;
-    //not using std::string to reduce memory consumption (there are might be millions of entries so each byte counts)
-    std::unique_ptr<char[]> name;
+    // flags are packed together with name crc and id
+    //used to mark entry to delete in function removePendingDelete
+    bool pendingDelete : 1;
+
+    bool bIsDir : 1;
+    // true between beginChildrenUpdate() and endChildrenUpdate()
+    bool childrenUpdating : 1;
+    // true if children were changed during batch update so they are not sorted anymore
+    bool childrenUnsorted : 1;
 };
 
 
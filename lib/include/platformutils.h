@@ -4,11 +4,36 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 /**
  * Collection of functions that a platform dependent
  */
 namespace PlatformUtils {
+    /**
+     * Metadata of directory that changes whenever list of its entries changes.
+     * Times are in nanoseconds since unix epoch.
+     * Changes of files inside directory (e.g. their size) don't change its stamp.
+     * Mount id is reported only to detect mount points without another call, it is not
+     * part of stamp and is not compared.
+     */
+    struct DirStamp {
+        int64_t modifyTime;
+        int64_t changeTime;
+        uint64_t inode;
+        // id of mounted filesystem that contains directory, 0 if it is not known
+        uint64_t mountId;
+
+        bool operator==(const DirStamp &other) const {
+            return modifyTime == other.modifyTime && changeTime == other.changeTime &&
+                   inode == other.inode;
+        }
+
+        bool operator!=(const DirStamp &other) const {
+            return !(*this == other);
+        }
+    };
+
     /**
      * Check if provided path exists and can be opened for scan
      * @param path to check
@@ -42,6 +67,14 @@ namespace PlatformUtils {
      */
     bool get_mount_space(const std::string &path, int64_t &totalSpace, int64_t &availableSpace);
 
+    /**
+     * Reads stamp of directory at specified path
+     * @param path to directory
+     * @param stamp - where to store stamp
+     * @return true if stamp is read successfully, false otherwise
+     */
+    bool getDirStamp(const std::string &path, DirStamp &stamp);
+
     /**
      * Deletes directory and all files inside
      * Provided path should be global path, otherwise it is not thread-safe to call this.
@@ -6,12 +6,17 @@
 #include <string>
 #include <vector>
 #include <mutex>          // std::mutex
+#include <condition_variable>
 #include <queue>
-#include <list>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <chrono>
 
+#include "filedb.h"
+#include "ScanQueue.h"
+#include "HardLinkSet.h"
 
 enum class ScannerStatus {
     IDLE,
@@ -24,26 +29,32 @@ class FileEntry;
 
 class FilePath;
 
-class FileDB;
-
 class SpaceWatcher;
 
+class FileIterator;
+
 class Logger;
 
 class SpaceScanner {
-    struct ScanRequest {
-        std::unique_ptr<FilePath> path;
-        bool recursive;
-    };
+    typedef ScanQueue::Request ScanRequest;
 public:
 
     /**
      * Starts scan of selected path
      * If path can't be scanned, throws an exception
      * @param path
+     * @param threadCount - number of threads that will scan directories in parallel,
+     *                      if 0 then getDefaultThreadCount() is used
+     * @param snapshotPath - path to snapshot created with saveSnapshot() (optional),
+     *                     it is not used if it was made with different size mode.
+     *                     If snapshot of the same path can be loaded from it, loaded data
+     *                     is available immediately and quick rescan verifies it in background.
+     * @param sizeMode - whether apparent size of files or space they take on disk is used
      * @throws std::runtime_error if path can't be scanned
      */
-    explicit SpaceScanner(const std::string &path);
+    explicit SpaceScanner(const std::string &path, unsigned threadCount = 0,
+                          const std::string &snapshotPath = std::string(),
+                          SizeMode sizeMode = SizeMode::APPARENT);
 
     ~SpaceScanner();
 
@@ -62,10 +73,33 @@ public:
 
     bool canResume();
 
-    void rescanPath(const FilePath &folder_path);
+    /**
+     * Rescans directory at given path and all its subdirectories
+     * In quick mode, directories whose stamp (modification and change time, inode)
+     * is the same as during previous scan are not listed again and their known children
+     * are kept. Subdirectories are still checked. Changes of file sizes inside such
+     * directories are not detected by quick rescan.
+     * @param folder_path
+     * @param quick - whether to perform quick rescan
+     */
+    void rescanPath(const FilePath &folder_path, bool quick = false);
 
     const FileDB& getFileDB() const;
 
+    SizeMode getSizeMode() const;
+
+    /**
+     * Saves current state of db to snapshot, so it can be loaded on next start
+     * @param snapshotPath
+     * @return true on success
+     */
+    bool saveSnapshot(const std::string &snapshotPath) const;
+
+    /**
+     * @return true if db was loaded from snapshot
+     */
+    bool isLoadedFromSnapshot() const;
+
     std::unique_ptr<FilePath> getCurrentScanPath();
 
     /**
@@ -76,6 +110,23 @@ public:
      */
     bool getWatcherLimits(int64_t &watchedNow, int64_t &watchLimit);
 
+    /**
+     * Get number of watches that are used by all processes of current user.
+     * Limit of watches is shared between them, so it should be bigger than this number
+     * plus number of directories that are not watched yet.
+     * Watches are counted only after limit was reached (see getWatcherLimits())
+     * @return number of watches or -1 if it is unknown
+     */
+    int64_t getWatcherUserWatchCount() const;
+
+    /**
+     * Get number of times when watcher lost events (e.g. inotify queue overflowed).
+     * After each such case whole tree is rescanned (not in quick mode, since lost
+     * changes of file sizes are not visible in directory stamps).
+     * @return
+     */
+    int64_t getWatcherLostEventsCount() const;
+
     /**
      * Returns true if it possible to determine scan progress.
      * For example, if we scan partition and can get total occupied space.
@@ -97,17 +148,106 @@ public:
 
     void setLogger(std::shared_ptr<Logger> logger);
 
+    /**
+     * Sets for how long changes detected by watcher are collected before rescan.
+     * All changes in the same directory during this time result in a single rescan of it.
+     * @param window
+     */
+    void setWatcherDebounce(std::chrono::milliseconds window);
+
+    /**
+     * Sets whether scan stays on filesystem of scanned path (enabled by default).
+     * If disabled, other mounted filesystems are scanned too, except for
+     * virtual ones (e.g. /proc). Applied to directories that are scanned after this call.
+     * @param enabled
+     */
+    void setOneFileSystem(bool enabled);
+
+    bool isOneFileSystem() const;
+
+    /**
+     * Limits memory used by scanned entries. When limit is exceeded, children of big
+     * subtrees are moved to spill file and loaded back when they are accessed.
+     * See FileDB::setMemoryBudget()
+     * @param bytes - memory budget, 0 to disable the limit
+     * @param spillPath - path to file where spilled entries are stored
+     * @return false if spill file can't be created
+     */
+    bool setMemoryBudget(int64_t bytes, const std::string &spillPath);
+
+    /**
+     * Limits depth of entries that are stored in db (0 means no limit, which is default).
+     * Directories at max depth are still scanned with all their subdirectories, but
+     * their content is not stored, it is only counted in their size and in total number
+     * of files and dirs (see FileDB::getAggregate()).
+     * Applied to directories that are scanned after this call.
+     * @param depth - depth of the deepest stored entries (children of root have depth 1)
+     */
+    void setMaxDepth(unsigned depth);
+
+    unsigned getMaxDepth() const;
+
+    /**
+     * Number of scan threads used when it is not specified explicitly.
+     * Based on std::thread::hardware_concurrency()
+     * @return
+     */
+    static unsigned getDefaultThreadCount();
+
 private:
-    std::thread workerThread;
+    /**
+     * Each worker owns a deque of directories that are discovered by it.
+     * Worker takes directories from the back of its own deque (so scan goes depth-first
+     * and memory stays low) and steals from the front of other deques when its own is empty
+     * (front holds directories closest to the root, so stolen work is usually big enough).
+     * Scanned directories are committed to db in batches. If db is busy (e.g. it is read by gui),
+     * worker keeps scanning other directories and commits everything later.
+     */
+    struct ScanWorker {
+        std::thread thread;
+        // protects tasks and currentPath
+        std::mutex mtx;
+        std::deque<ScanRequest> tasks;
+        std::unique_ptr<FilePath> currentPath;
+        // scanned but not yet committed directories, accessed only by worker thread
+        std::vector<FileDB::ChildrenUpdate> pendingUpdates;
+        // whether pending update at the same index was made by quick scan
+        std::vector<bool> pendingQuick;
+    };
+
+    std::vector<std::unique_ptr<ScanWorker>> workers;
     std::atomic<bool> runWorker;
     std::mutex scanMtx;
-    std::unique_ptr<FilePath> currentScannedPath;
+    /**
+     * Used with scan mutex. Notified when new requests are added, when status
+     * of scanner changes and when watcher has new events.
+     * Idle workers and stopScan() wait on it.
+     */
+    std::condition_variable scanCv;
+    // number of workers that wait (or are about to wait) for new requests
+    std::atomic<int> idleWorkers;
+
+    /**
+     * Number of requests that are in workers deques or are currently processed.
+     * Requests in scanQueue are not counted, scan is finished only when both
+     * scanQueue is empty and this counter is zero.
+     */
+    std::atomic<int64_t> pendingTasks;
+
+    // these are protected by scan mutex
+    std::chrono::steady_clock::time_point scanStartTime;
+    bool scannedRecursively;
 
     // true if we scan mount point so we can get info about how big it should be
     bool isMountScanned;
 
+    bool loadedFromSnapshot;
+
     //edits to queue should be mutex protected
-    std::list<ScanRequest> scanQueue;
+    //contains requests from outside of workers (rescans and watcher events)
+    ScanQueue scanQueue;
+    // size of scanQueue, used by workers to check queue without locking scan mutex
+    std::atomic<size_t> scanQueueSize;
 
     std::vector<std::string> availableRoots;
     /**
@@ -115,12 +255,28 @@ private:
      */
     std::vector<std::string> excludedMounts;
 
+    // mount id of scanned path, directories with other ids are mount points
+    bool hasRootMountId;
+    uint64_t rootMountId;
+    std::atomic<bool> oneFileSystem;
+
+    // number of parts in path of root, used to find depth of scanned directories
+    size_t rootPartCount;
+    std::atomic<unsigned> maxDepth;
+
     /**
      * If valid rootFile is available then this will update info about total and available space on this drive
      * Can be called multiple times, just need rootFile to be valid
      */
     void updateDiskSpace();
 
+    /**
+     * Files with many hard links that were found during scan.
+     * Only the first found link of each file has its size, so files are counted once.
+     * Cleared when the whole tree is rescanned.
+     */
+    HardLinkSet hardLinks;
+
     std::atomic<ScannerStatus> scannerStatus;
     std::unique_ptr<FileDB> db;
 
@@ -129,29 +285,110 @@ private:
 
     std::shared_ptr<Logger> logger;
 
-    void worker_run();
+    void worker_run(size_t workerIndex);
+
+    /**
+     * Takes next request for worker at given index.
+     * Requests from scanQueue are taken first, then worker's own deque
+     * is checked and if it is empty, request is stolen from other workers.
+     * @param workerIndex
+     * @param request - where to store taken request
+     * @return true if request was taken, false if there is no work
+     */
+    bool takeRequest(size_t workerIndex, ScanRequest &request);
+
+    /**
+     * Scans directory of provided request and adds result to worker's pending updates.
+     * Updates are committed when db is not busy or when there are too many of them.
+     * @param worker
+     * @param request
+     */
+    void processRequest(ScanWorker &worker, ScanRequest &request);
+
+    /**
+     * Commits pending updates of worker to db and puts all directories that should be
+     * scanned next into worker's deque. Each committed update completes one pending task.
+     * @param worker
+     * @param wait - whether to wait for db if it is busy
+     * @return true if anything was committed, false if there was nothing to commit or db was busy
+     */
+    bool commitUpdates(ScanWorker &worker, bool wait);
+
+    /**
+     * Removes all requests from scanQueue and deques of all workers.
+     * Requests that are currently processed are not affected.
+     * This function must be called with locked scan mutex.
+     */
+    void clearRequests();
+
+    /**
+     * Checks whether all requests are processed and if they are,
+     * finishes current scan and changes status to IDLE.
+     * This function must be called with locked scan mutex.
+     */
+    void finishScanIfDone();
 
     void checkForEvents();
 
     /**
-     * Adds specified path to queue. If such path already exist in queue,
-     * it will be moved to back (if toBack is true) or to front (otherwise).
-     * All paths in queue that contain this path, will be removed from queue
+     * Checks whether there are any requests that workers can take
+     * (or workers should stop).
+     * This function must be called with locked scan mutex.
+     * @return
+     */
+    bool hasRequests();
+
+    /**
+     * Wakes up workers that wait for new requests (if there are any).
+     * This function must be called without locked scan mutex.
+     */
+    void wakeIdleWorkers();
+
+    /**
+     * Adds specified path to scanQueue (see ScanQueue::push for how requests are merged)
+     * and wakes up idle workers.
      * This function must be called with locked scan mutex.
-     * If there are any path in queue that is contained in this path, then this
-     * path will not be added
      * @param path
-     * @param toBack
+     * @param recursiveScan
+     * @param toBack - whether to add to back or to front of queue
+     * @param quickScan
      */
-    void addToQueue(std::unique_ptr<FilePath> path, bool recursiveScan, bool toBack = true);
+    void addToQueue(std::unique_ptr<FilePath> path, bool recursiveScan, bool toBack = true,
+                    bool quickScan = false);
 
     /**
-     * Same as addToQueue but assumes that all paths in provided vector have common parent
+     * Checks whether directory at given path should not be scanned
+     * (it is another mount point or excluded path)
+     * This function must be called with locked scan mutex.
+     * @param path - path to directory with slash at the end
+     * @return
+     */
+    bool isExcludedDir(const std::string &path) const;
+
+    /**
+     * Checks whether directory is a mount point that should not be scanned.
+     * Paths are compared only if directory is on another filesystem than scanned path.
+     * @param path - path to directory with slash at the end
+     * @param stamp - stamp of directory
+     * @return
+     */
+    bool isSkippedMount(const std::string &path, const PlatformUtils::DirStamp &stamp);
+
+    /**
+     * Puts requests for given paths into worker's deque
+     * @param worker
      * @param paths
-     * @param recursiveScan
-     * @param toBack
+     * @param quick - whether requests are quick
+     */
+    void pushTasks(ScanWorker &worker, std::vector<std::unique_ptr<FilePath>> &paths, bool quick);
+
+    /**
+     * Checks whether stamp is old enough so any later change of directory will change it
+     * @param stamp
+     * @return
      */
-    void addChildrenToQueue(std::vector<std::unique_ptr<FilePath>> &paths, bool recursiveScan, bool toBack = true);
+    static bool isStampStable(const PlatformUtils::DirStamp &stamp);
+
 
     /**
      * Performs a scan at given path, creates entry for each child and populates scannedEntries vector
@@ -163,6 +400,30 @@ private:
     void scanChildrenAt(const FilePath &path,
                         std::vector<std::unique_ptr<FileEntry>> &scannedEntries,
                         std::vector<std::unique_ptr<FilePath>> *newPaths = nullptr);
+
+    /**
+     * Scans the whole subtree at given path without creating any entries
+     * Mount points inside of subtree are skipped the same way as during usual scan
+     * @param path - FilePath where to perform scan
+     * @param aggregate - where to store total size and number of files and dirs in subtree
+     */
+    void scanAggregateAt(const FilePath &path, FileDB::Aggregate &aggregate);
+
+    /**
+     * Size of file that should be counted in current size mode
+     * @param it - iterator that points to file
+     * @param dirPath - path to directory of file
+     * @param dirHash - hash of dirPath (used to identify hard links of file)
+     * @return
+     */
+    int64_t getCountedSize(const FileIterator &it, const std::string &dirPath, uint64_t dirHash);
+
+    /**
+     * Releases hard links that were owned by deleted files, so their other links are counted.
+     * Directories of such links are added to queue to be scanned again.
+     * @param deletedFiles
+     */
+    void releaseHardLinks(const std::vector<std::unique_ptr<FilePath>> &deletedFiles);
 };
 
 
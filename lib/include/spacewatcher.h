@@ -7,6 +7,9 @@
 #include <list>
 #include <thread>
 #include <atomic>
+#include <functional>
+#include <chrono>
+#include <unordered_map>
 
 
 class SpaceWatcher {
@@ -16,7 +19,10 @@ public:
         REMOVED = -1,
         MODIFIED = 3,
         OLD_NAME = -6,
-        NEW_NAME = 6
+        NEW_NAME = 6,
+        // some events were lost (e.g. event queue of OS overflowed), so anything inside
+        // of directory at parentpath (watched root) might have changed
+        EVENTS_LOST = 10
     };
 
     enum class AddDirStatus {
@@ -36,10 +42,13 @@ public:
      * If platform doesn't support recursive watching, only this
      * directory will be watched. Add more with calls to addDir
      * @param path
+     * @param watchFilesystem - on linux, watch whole filesystem with fanotify if there are
+     * enough permissions (otherwise inotify is used). Events inside of directories that are
+     * deleted before their events are read might be lost in this mode.
      * @throws std::runtime_error if failed to start watching provided path
      * @return
      */
-    static std::unique_ptr<SpaceWatcher> create(const std::string &path);
+    static std::unique_ptr<SpaceWatcher> create(const std::string &path, bool watchFilesystem = false);
 
     virtual ~SpaceWatcher();
 
@@ -51,6 +60,21 @@ public:
      */
     virtual int64_t getDirCountLimit() const = 0;
 
+    /**
+     * Get number of watches that are used by all processes of current user
+     * (they all share the same limit).
+     * Counting is slow, so watches are counted only when limit is reached.
+     * @return number of used watches or -1 if it is unknown or there is no limit
+     */
+    virtual int64_t getUserWatchCount() const { return -1; }
+
+    /**
+     * Whether all subdirectories of watched path are watched automatically.
+     * If not, each of them should be added with addDir()
+     * @return
+     */
+    virtual bool isRecursive() const { return false; }
+
     /**
      * Get number of directories that are added to watch using addDir();
      * If this watcher doesn't have a limit on watched dirs, this will always
@@ -59,12 +83,48 @@ public:
      */
     int64_t getWatchedDirCount() const;
 
+    /**
+     * Get number of times when watcher lost events because event queue of OS
+     * overflowed. Each time EVENTS_LOST event is added to queue.
+     * @return
+     */
+    int64_t getLostEventsCount() const;
+
     /**
      * Returns event if any is present.
-     * @return nullptr if there are no events
+     * If coalescing is enabled, event is returned only after its debounce window has passed.
+     * @return nullptr if there are no events (or they are not ready yet)
      */
     std::unique_ptr<FileEvent> popEvent();
 
+    /**
+     * Enables or disables coalescing of events by their parent directory.
+     * When enabled, all events for the same parent directory that are added while the first
+     * of them is in queue are merged into it, so there is only one event per changed directory.
+     * Event is held in queue for debounce window after it was added, so a burst of changes
+     * in the same directory (e.g. during build) results in a single event.
+     * If merged events are not the same, merged event has MODIFIED action and
+     * path to parent directory as filepath. EVENTS_LOST is never replaced by other actions.
+     * @param enabled
+     * @param debounceWindow - for how long first event for directory is held in queue
+     */
+    void setCoalescing(bool enabled, std::chrono::milliseconds debounceWindow = std::chrono::milliseconds(0));
+
+    /**
+     * Gets time when next event in queue will be available from popEvent()
+     * @param time - where to store time
+     * @return false if queue is empty
+     */
+    bool getNextEventTime(std::chrono::steady_clock::time_point &time);
+
+    /**
+     * Sets function that is called from watcher thread when event is added to empty queue.
+     * So consumer can sleep until it is notified and then take all events with popEvent().
+     * Listener is called without any locks held by watcher.
+     * @param listener - function to call or nullptr to stop notifications
+     */
+    void setEventListener(std::function<void()> listener);
+
     /**
      * Adds directory to watch. Watch should be already started.
      * Used on platforms that can't watch recursively (e.g. linux)
@@ -73,7 +133,7 @@ public:
     virtual AddDirStatus addDir(const std::string &path);
 
     /**
-     * Adds directory to watch. Watch should be already started.
+     * Removes directory and all its subdirectories from watch.
      * Used on platforms that can't watch recursively (e.g. linux)
      * @param path
      */
@@ -82,17 +142,58 @@ public:
 protected:
     SpaceWatcher();
 
+    /**
+     * Waits until there are new events (or until wakeUp() is called) and adds them to queue.
+     * It is called in a loop from watcher thread while watcher is running.
+     */
     virtual void readEvents() = 0;
 
+    /**
+     * Interrupts readEvents() if it is waiting for events.
+     * Called when watcher thread should stop.
+     */
+    virtual void wakeUp();
+
+    /**
+     * Starts watcher thread. Should be called only after watcher is fully constructed.
+     */
+    void startThread();
+
+    /**
+     * Stops watcher thread and waits for it to finish.
+     * Derived classes must call it in their destructor, before anything that
+     * readEvents() uses is released.
+     */
+    void stopThread();
 
     void addEvent(std::unique_ptr<FileEvent> event);
 
+    /**
+     * Adds EVENTS_LOST event and increases lost events counter.
+     * Should be called when watcher can't get events it was supposed to get.
+     * @param path - path to watched root directory
+     */
+    void reportLostEvents(const std::string &path);
+
 private:
 
-    int64_t watchedDirCount;
+    std::atomic<int64_t> watchedDirCount;
+    std::atomic<int64_t> lostEventsCount;
+
+    struct QueuedEvent {
+        std::unique_ptr<FileEvent> event;
+        // event is not returned by popEvent() before this time
+        std::chrono::steady_clock::time_point readyTime;
+    };
 
     std::mutex eventsMtx;
-    std::list<std::unique_ptr<FileEvent>> eventQueue;
+    std::list<QueuedEvent> eventQueue;
+    std::function<void()> eventListener;
+
+    bool coalesceEvents;
+    std::chrono::milliseconds debounceWindow;
+    // queued events by their parent path, used only when coalescing is enabled
+    std::unordered_map<std::string, FileEvent *> queuedByParent;
 
 
     std::atomic<bool> runThread;
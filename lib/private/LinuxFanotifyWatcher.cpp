@@ -0,0 +1,204 @@
+#include "LinuxFanotifyWatcher.h"
+#include "utils.h"
+
+#include <sys/fanotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+std::unique_ptr<LinuxFanotifyWatcher> LinuxFanotifyWatcher::create(const std::string &path) {
+    std::unique_ptr<LinuxFanotifyWatcher> watcher(new LinuxFanotifyWatcher());
+    if (!watcher->beginWatch(path))
+        return nullptr;
+    watcher->startThread();
+    return watcher;
+}
+
+LinuxFanotifyWatcher::LinuxFanotifyWatcher() : watchBuffer(watchBufferSize, 0),
+                                               fanotifyFd(-1), mountFd(-1), wakeFd(-1), epollFd(-1) {
+
+}
+
+LinuxFanotifyWatcher::~LinuxFanotifyWatcher() {
+    stopThread();
+    if (epollFd != -1)
+        close(epollFd);
+    if (wakeFd != -1)
+        close(wakeFd);
+    if (mountFd != -1)
+        close(mountFd);
+    if (fanotifyFd != -1)
+        close(fanotifyFd);
+}
+
+bool LinuxFanotifyWatcher::beginWatch(const std::string &path) {
+#ifdef FAN_REPORT_DFID_NAME
+    // events will have handle of directory and name of entry, so we don't need descriptor of each file
+    fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+                               O_RDONLY | O_LARGEFILE);
+    if (fanotifyFd == -1)
+        return false;
+
+    const auto EVENTS = FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
+    if (fanotify_mark(fanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, EVENTS, AT_FDCWD, path.c_str()) == -1)
+        return false;
+
+    mountFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    char *realPath = realpath(path.c_str(), nullptr);
+    if (mountFd == -1 || !realPath) {
+        free(realPath);
+        return false;
+    }
+    realRootPath = realPath;
+    free(realPath);
+    if (realRootPath.back() != '/')
+        realRootPath.push_back('/');
+    rootPath = path;
+    if (rootPath.back() != '/')
+        rootPath.push_back('/');
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (wakeFd == -1 || epollFd == -1)
+        return false;
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fanotifyFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fanotifyFd, &ev) == -1)
+        return false;
+    ev.data.fd = wakeFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != -1;
+#else
+    return false;
+#endif
+}
+
+void LinuxFanotifyWatcher::wakeUp() {
+    uint64_t value = 1;
+    auto written = write(wakeFd, &value, sizeof(value));
+    (void) written; // if counter is full, wake up is already pending
+}
+
+void LinuxFanotifyWatcher::readEvents() {
+    struct epoll_event events[2];
+    // wait without timeout, thread sleeps until there are events or wakeUp() is called
+    int count = epoll_wait(epollFd, events, 2, -1);
+    if (count <= 0)
+        return; // interrupted by signal, will be called again
+
+    bool hasEvents = false;
+    for (int i = 0; i < count; ++i) {
+        if (events[i].data.fd == wakeFd) {
+            uint64_t value;
+            auto numRead = read(wakeFd, &value, sizeof(value));
+            (void) numRead;
+        } else if (events[i].data.fd == fanotifyFd) {
+            hasEvents = true;
+        }
+    }
+    if (!hasEvents)
+        return;
+
+    // read everything that is available, so whole burst of events is processed at once
+    while (true) {
+        auto numRead = read(fanotifyFd, watchBuffer.data(), watchBufferSize);
+        if (numRead <= 0)
+            break;
+
+        auto metadata = reinterpret_cast<struct fanotify_event_metadata *>(watchBuffer.data());
+        while (FAN_EVENT_OK(metadata, numRead)) {
+            processFanotifyEvent(metadata);
+            metadata = FAN_EVENT_NEXT(metadata, numRead);
+        }
+    }
+}
+
+void LinuxFanotifyWatcher::processFanotifyEvent(const struct fanotify_event_metadata *metadata) {
+#ifdef FAN_REPORT_DFID_NAME
+    if (metadata->fd >= 0)
+        close(metadata->fd); // should not happen, events are reported without descriptors
+
+    if (metadata->mask & FAN_Q_OVERFLOW) {
+        reportLostEvents(rootPath);
+        return;
+    }
+
+    FileAction action;
+    if (metadata->mask & FAN_CREATE)
+        action = FileAction::ADDED;
+    else if (metadata->mask & FAN_DELETE)
+        action = FileAction::REMOVED;
+    else if (metadata->mask & FAN_MODIFY)
+        action = FileAction::MODIFIED;
+    else if (metadata->mask & FAN_MOVED_FROM)
+        action = FileAction::OLD_NAME;
+    else if (metadata->mask & FAN_MOVED_TO)
+        action = FileAction::NEW_NAME;
+    else
+        return;
+
+    auto info = reinterpret_cast<const struct fanotify_event_info_fid *>(metadata + 1);
+    auto end = reinterpret_cast<const char *>(metadata) + metadata->event_len;
+    if (reinterpret_cast<const char *>(info + 1) > end || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+        return;
+
+    auto handle = reinterpret_cast<struct file_handle *>(const_cast<unsigned char *>(info->handle));
+    auto name = reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes);
+    if (name >= end || strcmp(name, ".") == 0)
+        return; // event of directory itself, it is reported by its parent too
+
+    std::string handleBytes(reinterpret_cast<const char *>(handle),
+                            sizeof(struct file_handle) + handle->handle_bytes);
+    if (handleBytes != lastHandle) {
+        int dirFd = open_by_handle_at(mountFd, handle, O_PATH | O_CLOEXEC);
+        if (dirFd == -1)
+            return; // directory is already deleted
+
+        char linkPath[64];
+        snprintf(linkPath, sizeof(linkPath), "/proc/self/fd/%d", dirFd);
+        std::vector<char> dirPath(PATH_MAX + 1, 0);
+        auto length = readlink(linkPath, dirPath.data(), PATH_MAX);
+        close(dirFd);
+        if (length <= 0)
+            return;
+
+        lastHandle = std::move(handleBytes);
+        lastDirPath.assign(dirPath.data(), length);
+    }
+
+    // path of directory that was moved or deleted can't be used later
+    auto dirPath = lastDirPath;
+    if ((metadata->mask & FAN_ONDIR) && (action == FileAction::REMOVED || action == FileAction::OLD_NAME))
+        lastHandle.clear();
+
+    if (!toWatchedPath(dirPath))
+        return;
+
+    auto fileEvent = Utils::make_unique<FileEvent>();
+    fileEvent->action = action;
+    fileEvent->parentpath = dirPath;
+    fileEvent->filepath = dirPath + name;
+
+    addEvent(std::move(fileEvent));
+#endif
+}
+
+bool LinuxFanotifyWatcher::toWatchedPath(std::string &path) const {
+    const std::string deletedSuffix = " (deleted)";
+    if (path.size() >= deletedSuffix.size() &&
+        path.compare(path.size() - deletedSuffix.size(), deletedSuffix.size(), deletedSuffix) == 0)
+        return false;
+
+    if (path.back() != '/')
+        path.push_back('/');
+    // whole filesystem is watched, but only events inside root are needed
+    if (path.compare(0, realRootPath.size(), realRootPath) != 0)
+        return false;
+    path = rootPath + path.substr(realRootPath.size());
+    return true;
+}
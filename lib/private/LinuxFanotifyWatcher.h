@@ -0,0 +1,76 @@
+#ifndef SPACEDISPLAY_LINUXFANOTIFYWATCHER_H
+#define SPACEDISPLAY_LINUXFANOTIFYWATCHER_H
+
+#include "spacewatcher.h"
+
+#include <string>
+#include <memory>
+#include <vector>
+
+struct fanotify_event_metadata;
+
+/**
+ * Watcher that uses fanotify to watch whole filesystem with a single mark.
+ * Unlike inotify, there is no setup for each directory and no limit on number
+ * of watched directories, so addDir() is not needed.
+ * Requires CAP_SYS_ADMIN (and CAP_DAC_READ_SEARCH to resolve directories of events)
+ * and kernel that supports FAN_REPORT_DFID_NAME (5.9+).
+ * Events outside of watched path are ignored.
+ */
+class LinuxFanotifyWatcher : public SpaceWatcher {
+public:
+    ~LinuxFanotifyWatcher() override;
+
+    int64_t getDirCountLimit() const override { return -1; }
+
+    bool isRecursive() const override { return true; }
+
+    /**
+     * Creates watcher for filesystem that contains given path and starts watching it
+     * @param path
+     * @return nullptr if fanotify is not available (not supported or not enough permissions)
+     */
+    static std::unique_ptr<LinuxFanotifyWatcher> create(const std::string &path);
+
+protected:
+    void readEvents() override;
+
+    void wakeUp() override;
+
+private:
+    const int watchBufferSize = 1024 * 48;
+
+    std::vector<uint8_t> watchBuffer;
+
+    int fanotifyFd;
+    // any descriptor on watched filesystem, used to open directories by their handles
+    int mountFd;
+    // written to when readEvents() should stop waiting
+    int wakeFd;
+    // waits for both fanotify and wake descriptors
+    int epollFd;
+
+    // path that was passed to create(), with slash at the end
+    std::string rootPath;
+    // absolute path of rootPath without symlinks, with slash at the end
+    std::string realRootPath;
+
+    // events usually come in bursts for the same directory, so last resolved handle is remembered
+    std::string lastHandle;
+    std::string lastDirPath;
+
+    LinuxFanotifyWatcher();
+
+    bool beginWatch(const std::string &path);
+
+    void processFanotifyEvent(const struct fanotify_event_metadata *metadata);
+
+    /**
+     * Converts absolute path of directory to path inside of watched root
+     * @param path - absolute path of directory without slash at the end
+     * @return false if directory is not inside of watched root
+     */
+    bool toWatchedPath(std::string &path) const;
+};
+
+#endif //SPACEDISPLAY_LINUXFANOTIFYWATCHER_H
@@ -1,18 +1,51 @@
 #include "platformutils.h"
+#include "utils.h"
 
 #include "LinuxFileIterator.h"
 
-#include <sys/stat.h>
+#ifdef SPACEDISPLAY_HAVE_IO_URING
+#include "LinuxIoUring.h"
+#endif
+
+#include <atomic>
+#include <cstring>
 
-LinuxFileIterator::LinuxFileIterator(std::string path) :
-        valid(false), dir(false), size(0), path(std::move(path)) {
-    dirp = opendir(this->path.c_str());
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// size of buffer for getdents64, each call will return as many entries as fit into it
+static const size_t DIRENTS_BUFFER_SIZE = 64 * 1024;
+
+// if batch has at least this number of entries to stat, they are stat'ed with io_uring
+// for smaller batches there is no gain from having multiple requests in flight
+static const size_t MIN_URING_BATCH = 8;
+
+static std::atomic<bool> asyncStatEnabled(true);
+
+// layout of records returned by getdents64 syscall
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+LinuxFileIterator::LinuxFileIterator(const std::string &path) :
+        valid(false), dir(false), size(0), allocatedSize(0), hardLink(false), device(0), inode(0), batchPos(0) {
+    dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd != -1)
+        direntsBuffer = Utils::make_unique_arr<char>(DIRENTS_BUFFER_SIZE);
     getNextFileData();
 }
 
 LinuxFileIterator::~LinuxFileIterator() {
-    if (dirp != nullptr) {
-        closedir(dirp);
+    if (dirFd != -1) {
+        close(dirFd);
     }
 }
 
@@ -20,6 +53,10 @@ std::unique_ptr<FileIterator> FileIterator::create(const std::string &path) {
     return std::unique_ptr<LinuxFileIterator>(new LinuxFileIterator(path));
 }
 
+void FileIterator::setAsyncStatEnabled(bool enabled) {
+    asyncStatEnabled = enabled;
+}
+
 void LinuxFileIterator::operator++() {
     assertValid();
     getNextFileData();
@@ -44,32 +81,137 @@ int64_t LinuxFileIterator::getSize() const {
     return size;
 }
 
-void LinuxFileIterator::getNextFileData() {
-    valid = false;
-    if (dirp == nullptr)
-        return;
+int64_t LinuxFileIterator::getAllocatedSize() const {
+    assertValid();
+    return allocatedSize;
+}
 
-    struct stat file_stat{};
-    struct dirent *dp;
+bool LinuxFileIterator::getHardLinkId(uint64_t &device_, uint64_t &inode_) const {
+    assertValid();
+    if (!hardLink)
+        return false;
+    device_ = device;
+    inode_ = inode;
+    return true;
+}
+
+bool LinuxFileIterator::readBatch() {
+    batch.clear();
+    batchPos = 0;
+    if (dirFd == -1)
+        return false;
 
-    while ((dp = readdir(dirp)) != nullptr) {
-        name = dp->d_name;
-        if (name.empty() || name == "." || name == "..")
+    auto bytesRead = syscall(SYS_getdents64, dirFd, direntsBuffer.get(), DIRENTS_BUFFER_SIZE);
+    if (bytesRead <= 0)
+        return false;
+
+    for (long pos = 0; pos < bytesRead;) {
+        auto dirent = reinterpret_cast<linux_dirent64 *>(direntsBuffer.get() + pos);
+        pos += dirent->d_reclen;
+
+        auto entryName = dirent->d_name;
+        if (entryName[0] == '\0' || strcmp(entryName, ".") == 0 || strcmp(entryName, "..") == 0)
             continue;
-        break;
+
+        BatchEntry entry{};
+        entry.name = entryName;
+        entry.valid = true;
+        // size of directory is not needed, so if we know that entry is
+        // directory, we can skip stat for it completely
+        entry.dir = dirent->d_type == DT_DIR;
+        entry.needStat = !entry.dir;
+        batch.push_back(entry);
     }
+    statBatch();
+    return true;
+}
 
-    if (dp == nullptr)
+void LinuxFileIterator::statBatch() {
+    // buffers are reused between batches, statBatch is never called recursively
+    static thread_local std::vector<BatchEntry *> entries;
+
+    entries.clear();
+    for (auto &entry : batch) {
+        if (entry.needStat)
+            entries.push_back(&entry);
+    }
+    if (entries.empty())
         return;
 
-    // to get file info we need full path
-    std::string child = path;
-    child.push_back('/');
-    child.append(name);
+#ifdef SPACEDISPLAY_HAVE_IO_URING
+    static thread_local std::vector<const char *> names;
+    static thread_local std::vector<struct statx> results;
+    static thread_local std::vector<int> errors;
+
+    LinuxIoUring *ring = nullptr;
+    if (entries.size() >= MIN_URING_BATCH && asyncStatEnabled)
+        ring = LinuxIoUring::getThreadRing();
+
+    if (ring) {
+        names.clear();
+        for (auto entry : entries)
+            names.push_back(entry->name);
+        results.resize(entries.size());
+        errors.resize(entries.size());
+
+        if (ring->statx(dirFd, names.data(), results.data(), errors.data(), entries.size())) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                auto entry = entries[i];
+                if (errors[i] == 0) {
+                    auto &result = results[i];
+                    entry->dir = S_ISDIR(result.stx_mode);
+                    entry->size = entry->dir ? 0 : (int64_t) result.stx_size;
+                    // blocks are always counted in 512 byte units
+                    entry->allocatedSize = entry->dir ? 0 : (int64_t) result.stx_blocks * 512;
+                    entry->hardLink = !entry->dir && result.stx_nlink > 1;
+                    entry->device = makedev(result.stx_dev_major, result.stx_dev_minor);
+                    entry->inode = result.stx_ino;
+                } else
+                    entry->valid = false;
+            }
+            return;
+        }
+        // if ring failed, just stat everything without it
+    }
+#endif
+
+    struct stat file_stat{};
+    for (auto entry : entries) {
+        if (fstatat(dirFd, entry->name, &file_stat, AT_SYMLINK_NOFOLLOW) == 0) {
+            entry->dir = S_ISDIR(file_stat.st_mode);
+            entry->size = entry->dir ? 0 : file_stat.st_size;
+            entry->allocatedSize = entry->dir ? 0 : (int64_t) file_stat.st_blocks * 512;
+            entry->hardLink = !entry->dir && file_stat.st_nlink > 1;
+            entry->device = file_stat.st_dev;
+            entry->inode = file_stat.st_ino;
+        } else
+            entry->valid = false;
+    }
+}
+
+void LinuxFileIterator::getNextFileData() {
+    valid = false;
 
-    if (lstat(child.c_str(), &file_stat) == 0) {
-        valid = true;
-        dir = S_ISDIR(file_stat.st_mode);
-        size = file_stat.st_size;
+    while (true) {
+        if (batchPos >= batch.size() && !readBatch())
+            return;
+
+        // batch might be empty if it contained only "." and ".."
+        while (batchPos < batch.size()) {
+            auto &entry = batch[batchPos];
+            ++batchPos;
+            if (!entry.valid)
+                continue;
+
+            valid = true;
+            name = entry.name;
+            dir = entry.dir;
+            size = entry.size;
+            allocatedSize = entry.allocatedSize;
+            hardLink = entry.hardLink;
+            device = entry.device;
+            inode = entry.inode;
+            return;
+        }
     }
 }
@@ -3,11 +3,11 @@
 
 #include "FileIterator.h"
 
-#include <dirent.h>
+#include <vector>
 
 class LinuxFileIterator : public FileIterator {
 private:
-    explicit LinuxFileIterator(std::string path);
+    explicit LinuxFileIterator(const std::string &path);
 
 public:
     ~LinuxFileIterator() override;
@@ -22,20 +22,67 @@ public:
 
     int64_t getSize() const override;
 
+    int64_t getAllocatedSize() const override;
+
+    bool getHardLinkId(uint64_t &device, uint64_t &inode) const override;
+
     friend std::unique_ptr<FileIterator> FileIterator::create(const std::string &path);
 
 private:
+    /**
+     * Entry of directory that was read with getdents64.
+     * Name points directly into dirents buffer so it is valid only until next batch is read
+     */
+    struct BatchEntry {
+        const char *name;
+        bool dir;
+        // if type of entry is not known or we need its size, it should be stat'ed
+        bool needStat;
+        // false if stat of entry failed
+        bool valid;
+        int64_t size;
+        int64_t allocatedSize;
+        // true if file has more than one hard link
+        bool hardLink;
+        uint64_t device;
+        uint64_t inode;
+    };
+
     bool valid;
     std::string name;
     bool dir;
     int64_t size;
+    int64_t allocatedSize;
+    bool hardLink;
+    uint64_t device;
+    uint64_t inode;
+
+    // descriptor of iterated directory, all entries are stat'ed relative to it
+    int dirFd;
+
+    // buffer for raw data returned by getdents64
+    std::unique_ptr<char[]> direntsBuffer;
 
-    DIR *dirp;
-    std::string path;
+    // entries from the last read batch and index of current entry
+    std::vector<BatchEntry> batch;
+    size_t batchPos;
+
+    /**
+     * Reads next batch of entries from directory and stats all of them that need it
+     * @return false if there are no more entries in directory
+     */
+    bool readBatch();
+
+    /**
+     * Stats all entries in current batch that need it.
+     * If io_uring is available (in both build and kernel) and async stat is enabled,
+     * all stats are submitted at once and many of them are kept in flight,
+     * otherwise each entry is stat'ed with fstatat.
+     */
+    void statBatch();
 
     /**
-     * Gets file data for the next file returned by handle
-     * If handle is new (just returned by opendir) then filedata for the first file will be read
+     * Moves to the next valid entry, reading new batch if current one is processed
      */
     void getNextFileData();
 };
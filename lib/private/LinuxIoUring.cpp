@@ -0,0 +1,184 @@
+#include "LinuxIoUring.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// number of requests that can be in flight at the same time
+static const unsigned RING_ENTRIES = 128;
+
+enum class RingSupport {
+    UNKNOWN,
+    SUPPORTED,
+    NOT_SUPPORTED
+};
+
+// once some thread failed to create ring, there is no reason for other threads to try again
+static std::atomic<RingSupport> ringSupport(RingSupport::UNKNOWN);
+
+LinuxIoUring *LinuxIoUring::getThreadRing() {
+    static thread_local std::unique_ptr<LinuxIoUring> ring;
+
+    if (ring)
+        return ring.get();
+    if (ringSupport == RingSupport::NOT_SUPPORTED)
+        return nullptr;
+
+    std::unique_ptr<LinuxIoUring> newRing(new LinuxIoUring(RING_ENTRIES));
+    if (!newRing->init()) {
+        ringSupport = RingSupport::NOT_SUPPORTED;
+        return nullptr;
+    }
+    ringSupport = RingSupport::SUPPORTED;
+    ring = std::move(newRing);
+    return ring.get();
+}
+
+LinuxIoUring::LinuxIoUring(unsigned entries) :
+        ringEntries(entries), ringFd(-1),
+        sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+        sqes(nullptr), sqesSize(0),
+        sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+        cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr) {}
+
+LinuxIoUring::~LinuxIoUring() {
+    unmapRings();
+    if (ringFd != -1)
+        close(ringFd);
+}
+
+bool LinuxIoUring::init() {
+    io_uring_params params{};
+    ringFd = (int) syscall(__NR_io_uring_setup, ringEntries, &params);
+    if (ringFd < 0) {
+        // kernel is too old or io_uring is disabled (e.g. by seccomp or sysctl)
+        ringFd = -1;
+        return false;
+    }
+
+    // check that kernel supports statx operation
+    const unsigned probeOps = 256;
+    auto probeSize = sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op);
+    auto probeBuf = Utils::make_unique_arr<uint8_t>(probeSize);
+    memset(probeBuf.get(), 0, probeSize);
+    auto probe = reinterpret_cast<io_uring_probe *>(probeBuf.get());
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, probeOps) < 0 ||
+        probe->last_op < IORING_OP_STATX ||
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) == 0)
+        return false;
+
+    ringEntries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize = std::max(sqRingSize, cqRingSize);
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+        return false;
+
+    if (singleMmap) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+            return false;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqesPtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqesPtr == MAP_FAILED)
+        return false;
+    sqes = static_cast<io_uring_sqe *>(sqesPtr);
+
+    auto sqBase = static_cast<uint8_t *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sqBase + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sqBase + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sqBase + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sqBase + params.sq_off.array);
+
+    auto cqBase = static_cast<uint8_t *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cqBase + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cqBase + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cqBase + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cqBase + params.cq_off.cqes);
+
+    return true;
+}
+
+void LinuxIoUring::unmapRings() {
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED)
+        munmap(sqRing, sqRingSize);
+    sqes = nullptr;
+    sqRing = MAP_FAILED;
+    cqRing = MAP_FAILED;
+}
+
+bool LinuxIoUring::statx(int dirFd, const char *const *names, struct statx *results, int *errors, size_t count) {
+    size_t submitted = 0;
+    size_t completed = 0;
+    // number of requests that are put into submission queue but not consumed by kernel yet
+    unsigned notConsumed = 0;
+
+    while (completed < count) {
+        // fill submission queue with as many requests as possible
+        unsigned tail = *sqTail;
+        while (submitted < count && (submitted - completed) < ringEntries) {
+            unsigned index = tail & *sqMask;
+            auto sqe = &sqes[index];
+            memset(sqe, 0, sizeof(io_uring_sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = reinterpret_cast<uint64_t>(names[submitted]);
+            sqe->len = STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO;
+            sqe->off = reinterpret_cast<uint64_t>(&results[submitted]);
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = submitted;
+            sqArray[index] = index;
+            ++tail;
+            ++notConsumed;
+            ++submitted;
+        }
+        // kernel should see filled entries before it sees new tail
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        // submit new requests and wait until at least one is completed
+        auto res = syscall(__NR_io_uring_enter, ringFd, notConsumed, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (res >= 0) {
+            notConsumed -= (unsigned) res;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY &&
+                   submitted - notConsumed == completed) {
+            // nothing is in flight so it's safe to give up, but requests that
+            // were not consumed should be removed from queue since they point to our buffers
+            __atomic_store_n(sqTail, tail - notConsumed, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        unsigned head = *cqHead;
+        unsigned cqTailValue = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != cqTailValue) {
+            auto &cqe = cqes[head & *cqMask];
+            errors[cqe.user_data] = cqe.res;
+            ++completed;
+            ++head;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
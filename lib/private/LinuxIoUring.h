@@ -0,0 +1,72 @@
+#ifndef SPACEDISPLAY_LINUXIOURING_H
+#define SPACEDISPLAY_LINUXIOURING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <sys/stat.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * Minimal io_uring wrapper that is used to stat many files at once.
+ * Implemented with raw syscalls so there is no dependency on liburing.
+ * Each thread uses its own ring, rings are not thread-safe.
+ */
+class LinuxIoUring {
+public:
+    ~LinuxIoUring();
+
+    /**
+     * Returns ring that belongs to calling thread, creating it if needed.
+     * If io_uring (or statx operation) is not supported by kernel or disabled,
+     * nullptr is returned and caller should fallback to regular syscalls.
+     * @return pointer to ring or nullptr if io_uring is not available
+     */
+    static LinuxIoUring *getThreadRing();
+
+    /**
+     * Stats all provided entries (relative to dirFd) without following symlinks.
+     * All requests are submitted in batches and many of them are kept in flight,
+     * function returns when all of them are completed.
+     * @param dirFd - descriptor of directory that contains all entries
+     * @param names - names of entries to stat
+     * @param results - where to store stat result for each name
+     * @param errors - for each name 0 on success, -errno otherwise
+     * @param count - number of entries
+     * @return false if ring failed, results are not valid in this case
+     */
+    bool statx(int dirFd, const char *const *names, struct statx *results, int *errors, size_t count);
+
+private:
+    explicit LinuxIoUring(unsigned entries);
+
+    bool init();
+
+    void unmapRings();
+
+    unsigned ringEntries;
+    int ringFd;
+
+    // mapped rings, sq and cq might share the same mapping
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    io_uring_sqe *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    io_uring_cqe *cqes;
+};
+
+#endif //SPACEDISPLAY_LINUXIOURING_H
@@ -0,0 +1,42 @@
+#include "MappedFile.h"
+#include "utils.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string &path) : ptr(nullptr), length(0) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(Utils::strFormat("Can't open %s", path.c_str()));
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error(Utils::strFormat("Can't map empty file %s", path.c_str()));
+    }
+    length = size_t(st.st_size);
+
+    auto addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    // mapping stays valid after file is closed
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw std::runtime_error(Utils::strFormat("Can't map %s", path.c_str()));
+
+    ptr = static_cast<const uint8_t *>(addr);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<uint8_t *>(ptr), length);
+}
+
+const uint8_t *MappedFile::data() const {
+    return ptr;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
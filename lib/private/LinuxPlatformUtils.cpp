@@ -6,8 +6,10 @@
 #include <fstream>
 #include <regex>
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 
 static void processMountPoints(const std::function<void(const std::string &path, bool isExcluded)> &consumer);
@@ -56,6 +58,33 @@ bool PlatformUtils::get_mount_space(const std::string &path, int64_t &totalSpace
         return false;
 }
 
+bool PlatformUtils::getDirStamp(const std::string &path, DirStamp &stamp) {
+#ifdef STATX_MNT_ID
+    // mount id is different for bind mounts of the same device, so they are detected as well
+    struct statx stx{};
+    if (statx(AT_FDCWD, path.c_str(), 0, STATX_BASIC_STATS | STATX_MNT_ID, &stx) == 0) {
+        if (!S_ISDIR(stx.stx_mode))
+            return false;
+        stamp.modifyTime = int64_t(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+        stamp.changeTime = int64_t(stx.stx_ctime.tv_sec) * 1000000000 + stx.stx_ctime.tv_nsec;
+        stamp.inode = stx.stx_ino;
+        if (stx.stx_mask & STATX_MNT_ID)
+            stamp.mountId = stx.stx_mnt_id;
+        else
+            stamp.mountId = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        return true;
+    }
+#endif
+    struct stat st{};
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return false;
+    stamp.modifyTime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.changeTime = int64_t(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+    stamp.inode = uint64_t(st.st_ino);
+    stamp.mountId = st.st_dev;
+    return true;
+}
+
 bool PlatformUtils::deleteDir(const std::string &path) {
     bool deleted = true;
     try {
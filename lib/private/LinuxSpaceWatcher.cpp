@@ -1,47 +1,173 @@
 #include "LinuxSpaceWatcher.h"
+#include "LinuxFanotifyWatcher.h"
 #include "utils.h"
 
 #include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstring>
 
 #include <iostream>
 #include <fstream>
 
-std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path) {
+// limit is re-read in background with this interval
+static const std::chrono::milliseconds LIMITS_UPDATE_INTERVAL(10000);
+// when limit is reached, limits are updated but not more often than this
+static const std::chrono::milliseconds LIMITS_MIN_UPDATE_INTERVAL(1000);
+
+static int64_t steadyNowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path, bool watchFilesystem) {
+    if (watchFilesystem) {
+        // fanotify watches whole filesystem with a single mark but is available only with CAP_SYS_ADMIN
+        auto fanotifyWatcher = LinuxFanotifyWatcher::create(path);
+        if (fanotifyWatcher)
+            return fanotifyWatcher;
+    }
+
     auto *ptr = new LinuxSpaceWatcher();
     if (!ptr->beginWatch(path)) {
         delete ptr;
         throw std::runtime_error("Can't start watching " + path);
     }
+    ptr->startThread();
     return std::unique_ptr<SpaceWatcher>(ptr);
 }
 
-LinuxSpaceWatcher::LinuxSpaceWatcher() : inotifyFd(-1), watchBuffer(watchBufferSize, 0) {
+LinuxSpaceWatcher::LinuxSpaceWatcher() : watchBuffer(watchBufferSize, 0), inotifyFd(-1), wakeFd(-1), epollFd(-1),
+                                         dirCountLimit(0), userWatchCount(-1), limitsUpdateTime(0),
+                                         userWatchCountTime(0) {
 
 }
 
 LinuxSpaceWatcher::~LinuxSpaceWatcher() {
+    stopThread();
+    if (epollFd != -1)
+        close(epollFd);
+    if (wakeFd != -1)
+        close(wakeFd);
     if (inotifyFd != -1) {
         close(inotifyFd);
         std::lock_guard<std::mutex> lock(inotifyWdsMtx);
         inotifyWds.clear();
+        inotifyPaths.clear();
     }
 }
 
 bool LinuxSpaceWatcher::beginWatch(const std::string &path) {
-    inotifyFd = inotify_init1(IN_NONBLOCK);
-    if (inotifyFd != -1)
-        return addDir(path) == SpaceWatcher::AddDirStatus::ADDED;
-    return false;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (inotifyFd == -1 || wakeFd == -1 || epollFd == -1)
+        return false;
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = inotifyFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &ev) == -1)
+        return false;
+    ev.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) == -1)
+        return false;
+
+    rootPath = path;
+    if (rootPath.back() != '/')
+        rootPath.push_back('/');
+
+    updateLimits(std::chrono::milliseconds(0));
+
+    return addDir(path) == SpaceWatcher::AddDirStatus::ADDED;
 }
 
 int64_t LinuxSpaceWatcher::getDirCountLimit() const {
-    int64_t limit = 0;
+    return dirCountLimit;
+}
 
+int64_t LinuxSpaceWatcher::getUserWatchCount() const {
+    return userWatchCount;
+}
+
+void LinuxSpaceWatcher::updateLimits(std::chrono::milliseconds minAge) {
+    std::unique_lock<std::mutex> lock(limitsMtx, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+    auto now = steadyNowNs();
+    if (limitsUpdateTime != 0 &&
+        now - limitsUpdateTime < std::chrono::duration_cast<std::chrono::nanoseconds>(minAge).count())
+        return;
+
+    int64_t limit = 0;
     std::ifstream file("/proc/sys/fs/inotify/max_user_watches");
     file >> limit;
 
-    return limit;
+    dirCountLimit = limit;
+    limitsUpdateTime = now;
+}
+
+void LinuxSpaceWatcher::updateUserWatchCount() {
+    std::unique_lock<std::mutex> lock(limitsMtx, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+    auto now = steadyNowNs();
+    if (userWatchCountTime != 0 &&
+        now - userWatchCountTime <
+        std::chrono::duration_cast<std::chrono::nanoseconds>(LIMITS_MIN_UPDATE_INTERVAL).count())
+        return;
+
+    userWatchCount = countUserWatches();
+    userWatchCountTime = now;
+}
+
+int64_t LinuxSpaceWatcher::countUserWatches() {
+    auto uid = getuid();
+    int64_t count = 0;
+
+    auto procDir = opendir("/proc");
+    if (!procDir)
+        return -1;
+
+    // each inotify instance has fdinfo file with one line for each of its watches
+    while (auto procEntry = readdir(procDir)) {
+        if (procEntry->d_name[0] < '0' || procEntry->d_name[0] > '9')
+            continue;
+        std::string pidPath = std::string("/proc/") + procEntry->d_name;
+        struct stat pidStat{};
+        if (stat(pidPath.c_str(), &pidStat) != 0 || pidStat.st_uid != uid)
+            continue;
+
+        auto fdDir = opendir((pidPath + "/fd").c_str());
+        if (!fdDir)
+            continue;
+        while (auto fdEntry = readdir(fdDir)) {
+            if (fdEntry->d_name[0] == '.')
+                continue;
+            auto fdPath = pidPath + "/fd/" + fdEntry->d_name;
+            char target[64];
+            auto length = readlink(fdPath.c_str(), target, sizeof(target) - 1);
+            if (length <= 0)
+                continue;
+            target[length] = '\0';
+            if (strcmp(target, "anon_inode:inotify") != 0)
+                continue;
+
+            std::ifstream fdInfo(pidPath + "/fdinfo/" + fdEntry->d_name);
+            std::string line;
+            while (std::getline(fdInfo, line)) {
+                if (line.compare(0, 11, "inotify wd:") == 0)
+                    ++count;
+            }
+        }
+        closedir(fdDir);
+    }
+    closedir(procDir);
+    return count;
 }
 
 SpaceWatcher::AddDirStatus LinuxSpaceWatcher::addDir(const std::string &path) {
@@ -56,6 +182,9 @@ SpaceWatcher::AddDirStatus LinuxSpaceWatcher::addDir(const std::string &path) {
     if (wd == -1) {
         switch (errno) {
             case ENOSPC:
+                // limit might be changed by user or watches might be used by other processes
+                updateLimits(LIMITS_MIN_UPDATE_INTERVAL);
+                updateUserWatchCount();
                 return AddDirStatus::DIR_LIMIT_REACHED;
         }
         return AddDirStatus::ACCESS_DENIED; //this is a default, although not very accurate
@@ -63,26 +192,48 @@ SpaceWatcher::AddDirStatus LinuxSpaceWatcher::addDir(const std::string &path) {
     std::lock_guard<std::mutex> lock(inotifyWdsMtx);
     auto it = inotifyWds.find(wd);
     if (it != inotifyWds.end()) {
+        // the same directory was watched with different path (e.g. it was moved)
+        inotifyPaths.erase(it->second);
         it->second = path;
     } else {
         inotifyWds[wd] = path;
         SpaceWatcher::addDir(path);
     }
+    inotifyPaths[path] = wd;
     return AddDirStatus::ADDED;
 }
 
 void LinuxSpaceWatcher::rmDir(const std::string &path) {
-    //TODO
-    SpaceWatcher::rmDir(path);
+    auto dirPath = path;
+    if (dirPath.empty() || dirPath.back() != '/')
+        dirPath.push_back('/');
+
+    // all watched subdirectories are also removed, they follow directory itself in ordered map
+    std::lock_guard<std::mutex> lock(inotifyWdsMtx);
+    auto it = inotifyPaths.lower_bound(dirPath);
+    while (it != inotifyPaths.end() && it->first.compare(0, dirPath.size(), dirPath) == 0) {
+        // IN_IGNORED will be received for removed watch, but it is already not in maps
+        inotify_rm_watch(inotifyFd, it->second);
+        inotifyWds.erase(it->second);
+        SpaceWatcher::rmDir(it->first);
+        it = inotifyPaths.erase(it);
+    }
 }
 
 void LinuxSpaceWatcher::processInotifyEvent(struct inotify_event *inotifyEvent) {
+    if (inotifyEvent->mask & IN_Q_OVERFLOW) {
+        // kernel dropped events, we don't know where they happened so whole tree should be checked
+        reportLostEvents(rootPath);
+        return;
+    }
+
     if (inotifyEvent->mask & IN_IGNORED) {
         //watch was removed so remove it from our map
         std::lock_guard<std::mutex> lock(inotifyWdsMtx);
         auto it = inotifyWds.find(inotifyEvent->wd);
         if (it != inotifyWds.end()) {
             SpaceWatcher::rmDir(it->second);
+            inotifyPaths.erase(it->second);
             inotifyWds.erase(it);
         }
         return;
@@ -128,7 +279,41 @@ void LinuxSpaceWatcher::processInotifyEvent(struct inotify_event *inotifyEvent)
     addEvent(std::move(fileEvent));
 }
 
+void LinuxSpaceWatcher::wakeUp() {
+    uint64_t value = 1;
+    auto written = write(wakeFd, &value, sizeof(value));
+    (void) written; // if counter is full, wake up is already pending
+}
+
 void LinuxSpaceWatcher::readEvents() {
+    using namespace std::chrono;
+    // thread sleeps until there are events, wakeUp() is called or limit should be re-read
+    auto sinceUpdate = nanoseconds(steadyNowNs() - limitsUpdateTime);
+    auto timeout = duration_cast<milliseconds>(LIMITS_UPDATE_INTERVAL - sinceUpdate).count() + 1;
+    if (timeout < 0)
+        timeout = 0;
+
+    struct epoll_event events[2];
+    int count = epoll_wait(epollFd, events, 2, static_cast<int>(timeout));
+    if (count == 0)
+        updateLimits(LIMITS_UPDATE_INTERVAL);
+    if (count <= 0)
+        return; // interrupted by signal or timeout, will be called again
+
+    bool hasEvents = false;
+    for (int i = 0; i < count; ++i) {
+        if (events[i].data.fd == wakeFd) {
+            uint64_t value;
+            auto numRead = read(wakeFd, &value, sizeof(value));
+            (void) numRead;
+        } else if (events[i].data.fd == inotifyFd) {
+            hasEvents = true;
+        }
+    }
+    if (!hasEvents)
+        return;
+
+    // read everything that is available, so whole burst of events is processed at once
     while (true) {
         auto numRead = read(inotifyFd, watchBuffer.data(), watchBufferSize);
         if (numRead <= 0)
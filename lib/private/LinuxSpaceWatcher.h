@@ -8,6 +8,7 @@
 #include <atomic>
 #include <vector>
 #include <unordered_map>
+#include <map>
 
 struct inotify_event;
 
@@ -15,16 +16,25 @@ class LinuxSpaceWatcher : public SpaceWatcher {
 public:
     ~LinuxSpaceWatcher() override;
 
+    /**
+     * Limit is read periodically (and when limit is reached) by watcher,
+     * so this function doesn't access filesystem and is cheap to call.
+     * @return
+     */
     int64_t getDirCountLimit() const override;
 
+    int64_t getUserWatchCount() const override;
+
     AddDirStatus addDir(const std::string &path) override;
 
     void rmDir(const std::string &path) override;
 
-    friend std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path);
+    friend std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path, bool watchFilesystem);
 protected:
     void readEvents() override;
 
+    void wakeUp() override;
+
 private:
 
     const int watchBufferSize = 1024 * 48;
@@ -32,13 +42,52 @@ private:
     std::vector<uint8_t> watchBuffer;
 
     int inotifyFd;
+    // path that was passed to beginWatch(), with slash at the end
+    std::string rootPath;
+    // written to when readEvents() should stop waiting
+    int wakeFd;
+    // waits for both inotify and wake descriptors
+    int epollFd;
+
+    // limits are read from /proc, which is too slow to do each time they are requested
+    std::atomic<int64_t> dirCountLimit;
+    std::atomic<int64_t> userWatchCount;
+    // time of last update of limits (in steady clock nanoseconds)
+    std::atomic<int64_t> limitsUpdateTime;
+    // watches of user are counted only when limit is reached, since it is slow
+    std::atomic<int64_t> userWatchCountTime;
+    // locked while limits are updated, so they are not updated by many threads at once
+    std::mutex limitsMtx;
+    // watched directories by their descriptors and descriptors by paths, both are protected by mutex
+    // paths are ordered so all watched subdirectories of any directory are next to each other
     std::unordered_map<int, std::string> inotifyWds;
+    std::map<std::string, int> inotifyPaths;
     std::mutex inotifyWdsMtx;
 
     LinuxSpaceWatcher();
 
     bool beginWatch(const std::string &path);
 
+    /**
+     * Reads current limit of watches.
+     * Does nothing if limits were updated less than minAge ago or are updated right now
+     * @param minAge
+     */
+    void updateLimits(std::chrono::milliseconds minAge);
+
+    /**
+     * Counts watches of current user, it reads fdinfo of all user processes so
+     * it should be called only when limit is reached.
+     * Does nothing if count was updated recently or is updated right now
+     */
+    void updateUserWatchCount();
+
+    /**
+     * Counts inotify watches of all processes that belong to current user
+     * @return
+     */
+    static int64_t countUserWatches();
+
     void processInotifyEvent(struct inotify_event *inotifyEvent);
 };
 
@@ -26,6 +26,10 @@ std::unique_ptr<FileIterator> FileIterator::create(const std::string &path) {
     return std::unique_ptr<WinFileIterator>(new WinFileIterator(path));
 }
 
+void FileIterator::setAsyncStatEnabled(bool /*enabled*/) {
+    // all data is returned together with names of files, nothing is stat'ed
+}
+
 void WinFileIterator::operator++() {
     assertValid();
     WIN32_FIND_DATAW fileData;
@@ -0,0 +1,55 @@
+#include "MappedFile.h"
+#include "platformutils.h"
+#include "utils.h"
+
+#include <stdexcept>
+
+#include <Windows.h>
+
+MappedFile::MappedFile(const std::string &path) : ptr(nullptr), length(0) {
+    auto wpath = PlatformUtils::str2wstr(path);
+
+    auto handle = CreateFileW(
+            wpath.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error(Utils::strFormat("Can't open %s", path.c_str()));
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0) {
+        CloseHandle(handle);
+        throw std::runtime_error(Utils::strFormat("Can't map empty file %s", path.c_str()));
+    }
+    length = size_t(fileSize.QuadPart);
+
+    auto mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(handle);
+    if (!mapping)
+        throw std::runtime_error(Utils::strFormat("Can't map %s", path.c_str()));
+
+    // view stays valid after handles are closed
+    auto addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!addr)
+        throw std::runtime_error(Utils::strFormat("Can't map %s", path.c_str()));
+
+    ptr = static_cast<const uint8_t *>(addr);
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(ptr);
+}
+
+const uint8_t *MappedFile::data() const {
+    return ptr;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
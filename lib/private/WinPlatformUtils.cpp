@@ -73,6 +73,39 @@ bool PlatformUtils::get_mount_space(const std::string &path, int64_t &totalSpace
         return false;
 }
 
+bool PlatformUtils::getDirStamp(const std::string &path, DirStamp &stamp) {
+    auto wpath = PlatformUtils::str2wstr(path);
+
+    auto handle = CreateFileW(
+            wpath.c_str(),
+            FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS,
+            nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    FILE_BASIC_INFO basicInfo;
+    bool result = GetFileInformationByHandle(handle, &info) != 0 &&
+                  GetFileInformationByHandleEx(handle, FileBasicInfo, &basicInfo, sizeof(basicInfo)) != 0 &&
+                  (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    CloseHandle(handle);
+    if (!result)
+        return false;
+
+    // file times are in 100ns intervals since 1601-01-01
+    const int64_t epochDiff = 116444736000000000LL;
+    stamp.modifyTime = (basicInfo.LastWriteTime.QuadPart - epochDiff) * 100;
+    stamp.changeTime = (basicInfo.ChangeTime.QuadPart - epochDiff) * 100;
+    stamp.inode = (uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    stamp.mountId = info.dwVolumeSerialNumber;
+    return true;
+}
+
 std::wstring PlatformUtils::str2wstr(std::string const &str) {
     int len = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int) str.size(), nullptr, 0);
     std::wstring ret(len, '\0');
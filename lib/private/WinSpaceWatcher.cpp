@@ -4,13 +4,16 @@
 #include "utils.h"
 
 #include <iostream>
+#include <chrono>
 
-std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path) {
+std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path, bool watchFilesystem) {
+    // watcher is always recursive, so there is no difference between modes
     auto *ptr = new WinSpaceWatcher();
     if (!ptr->beginWatch(path)) {
         delete ptr;
         throw std::runtime_error("Can't start watching " + path);
     }
+    ptr->startThread();
     return std::unique_ptr<SpaceWatcher>(ptr);
 }
 
@@ -19,6 +22,7 @@ WinSpaceWatcher::WinSpaceWatcher() : watchedDir(INVALID_HANDLE_VALUE) {
 }
 
 WinSpaceWatcher::~WinSpaceWatcher() {
+    stopThread();
     if (watchedDir != INVALID_HANDLE_VALUE) {
         CloseHandle(watchedDir);
         watchedPath.clear();
@@ -47,6 +51,12 @@ bool WinSpaceWatcher::beginWatch(const std::string &path) {
     return false;
 }
 
+void WinSpaceWatcher::wakeUp() {
+    // cancels ReadDirectoryChangesW that is waiting in watcher thread
+    if (watchedDir != INVALID_HANDLE_VALUE)
+        CancelIoEx(watchedDir, nullptr);
+}
+
 void WinSpaceWatcher::readEvents() {
     if (watchedDir == INVALID_HANDLE_VALUE)
         return;
@@ -63,8 +73,16 @@ void WinSpaceWatcher::readEvents() {
             nullptr,
             nullptr
     );
-    if (success == 0 || bytesReturned == 0)
+    if (success != 0 && bytesReturned == 0) {
+        // buffer overflowed and all its events are discarded
+        reportLostEvents(watchedPath);
         return;
+    }
+    if (success == 0) {
+        // don't spin if watching fails for some reason
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return;
+    }
 
     //calculate required number of dwords to hold returned bytes
     auto dwords = bytesReturned / sizeof(DWORD) + 1;
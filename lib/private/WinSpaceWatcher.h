@@ -16,10 +16,14 @@ public:
 
     int64_t getDirCountLimit() const override { return -1; }
 
-    friend std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path);
+    bool isRecursive() const override { return true; }
+
+    friend std::unique_ptr<SpaceWatcher> SpaceWatcher::create(const std::string &path, bool watchFilesystem);
 protected:
     void readEvents() override;
 
+    void wakeUp() override;
+
 private:
     WinSpaceWatcher();
 
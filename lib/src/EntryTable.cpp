@@ -0,0 +1,199 @@
+#include "EntryTable.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+const uint32_t EntryTable::nullRef;
+const uint32_t EntryTable::maxRef;
+
+namespace {
+    // end of free list of chunk
+    const uint32_t NO_SLOT = UINT32_MAX;
+
+    std::atomic<size_t> shardCounter(0);
+
+    size_t getThreadShard(size_t shardCount) {
+        static thread_local size_t shard = shardCounter++;
+        return shard % shardCount;
+    }
+
+    void *allocateChunkMemory(size_t size) {
+#ifdef _WIN32
+        return _aligned_malloc(size, size);
+#else
+        void *ptr;
+        if (posix_memalign(&ptr, size, size) != 0)
+            return nullptr;
+        return ptr;
+#endif
+    }
+
+    void freeChunkMemory(void *ptr) {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    uint32_t getChunkCapacity(size_t objectSize, size_t available, size_t maxSlots) {
+        auto capacity = available / objectSize;
+        return uint32_t(capacity < maxSlots ? capacity : maxSlots);
+    }
+}
+
+EntryTable::EntryTable(size_t objectSize_) :
+        objectSize((objectSize_ + 7) & ~size_t(7)),
+        chunkCapacity(getChunkCapacity(objectSize, CHUNK_SIZE - CHUNK_HEADER_SIZE, size_t(1) << SLOT_BITS)),
+        chunks(new std::atomic<Chunk *>[MAX_CHUNKS]),
+        // chunk 0 is never used, so nullRef never points to object
+        nextChunkIndex(1), objectCount(0), reservedSize(0) {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i)
+        chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+EntryTable::~EntryTable() {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        auto chunk = chunks[i].load(std::memory_order_relaxed);
+        if (chunk)
+            freeChunkMemory(chunk);
+    }
+}
+
+void *EntryTable::allocate(uint32_t &ref) {
+    auto &shard = shards[getThreadShard(SHARD_COUNT)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto chunk = shard.partialChunks;
+    if (!chunk) {
+        chunk = createChunk(shard);
+        listChunk(shard, chunk);
+    }
+
+    uint32_t slot;
+    if (chunk->freeSlot != NO_SLOT) {
+        slot = chunk->freeSlot;
+        auto ptr = reinterpret_cast<char *>(chunk) + CHUNK_HEADER_SIZE + slot * objectSize;
+        chunk->freeSlot = *reinterpret_cast<uint32_t *>(ptr);
+    } else {
+        slot = chunk->bumpedCount;
+        ++chunk->bumpedCount;
+    }
+    ++chunk->usedCount;
+    if (chunk->usedCount == chunkCapacity)
+        unlistChunk(shard, chunk);
+
+    ++objectCount;
+    ref = (chunk->index << SLOT_BITS) | slot;
+    return reinterpret_cast<char *>(chunk) + CHUNK_HEADER_SIZE + slot * objectSize;
+}
+
+void EntryTable::deallocate(void *ptr) {
+    if (!ptr)
+        return;
+
+    auto chunk = reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(CHUNK_SIZE - 1));
+    auto &shard = *chunk->shard;
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    *static_cast<uint32_t *>(ptr) = chunk->freeSlot;
+    chunk->freeSlot = getRef(ptr) & SLOT_MASK;
+    --chunk->usedCount;
+    --objectCount;
+
+    if (!chunk->isListed)
+        listChunk(shard, chunk);
+
+    // keep at least one chunk in shard, so we don't create and free chunk
+    // when the same object is allocated and freed repeatedly
+    if (chunk->usedCount == 0 && shard.partialCount > 1) {
+        unlistChunk(shard, chunk);
+        freeChunk(chunk);
+    }
+}
+
+uint32_t EntryTable::getRef(const void *ptr) const {
+    auto address = reinterpret_cast<uintptr_t>(ptr);
+    auto chunk = reinterpret_cast<const Chunk *>(address & ~uintptr_t(CHUNK_SIZE - 1));
+    auto offset = address - reinterpret_cast<uintptr_t>(chunk) - CHUNK_HEADER_SIZE;
+    return (chunk->index << SLOT_BITS) | uint32_t(offset / objectSize);
+}
+
+int64_t EntryTable::getObjectCount() const {
+    return objectCount;
+}
+
+int64_t EntryTable::getReservedSize() const {
+    return reservedSize;
+}
+
+EntryTable::Chunk *EntryTable::createChunk(Shard &shard) {
+    uint32_t index;
+    {
+        std::lock_guard<std::mutex> lock(chunksMtx);
+        if (!freeChunkIndices.empty()) {
+            index = freeChunkIndices.back();
+            freeChunkIndices.pop_back();
+        } else if (nextChunkIndex < MAX_CHUNKS) {
+            index = nextChunkIndex++;
+        } else {
+            throw std::bad_alloc();
+        }
+    }
+
+    auto memory = allocateChunkMemory(CHUNK_SIZE);
+    if (!memory) {
+        std::lock_guard<std::mutex> lock(chunksMtx);
+        freeChunkIndices.push_back(index);
+        throw std::bad_alloc();
+    }
+    auto chunk = static_cast<Chunk *>(memory);
+    chunk->shard = &shard;
+    chunk->prev = nullptr;
+    chunk->next = nullptr;
+    chunk->isListed = false;
+    chunk->index = index;
+    chunk->freeSlot = NO_SLOT;
+    chunk->bumpedCount = 0;
+    chunk->usedCount = 0;
+    chunks[index].store(chunk, std::memory_order_release);
+    reservedSize += CHUNK_SIZE;
+    return chunk;
+}
+
+void EntryTable::freeChunk(Chunk *chunk) {
+    auto index = chunk->index;
+    chunks[index].store(nullptr, std::memory_order_relaxed);
+    freeChunkMemory(chunk);
+    reservedSize -= CHUNK_SIZE;
+
+    std::lock_guard<std::mutex> lock(chunksMtx);
+    freeChunkIndices.push_back(index);
+}
+
+void EntryTable::listChunk(Shard &shard, Chunk *chunk) {
+    chunk->prev = nullptr;
+    chunk->next = shard.partialChunks;
+    if (shard.partialChunks)
+        shard.partialChunks->prev = chunk;
+    shard.partialChunks = chunk;
+    chunk->isListed = true;
+    ++shard.partialCount;
+}
+
+void EntryTable::unlistChunk(Shard &shard, Chunk *chunk) {
+    if (chunk->prev)
+        chunk->prev->next = chunk->next;
+    else
+        shard.partialChunks = chunk->next;
+    if (chunk->next)
+        chunk->next->prev = chunk->prev;
+    chunk->prev = nullptr;
+    chunk->next = nullptr;
+    chunk->isListed = false;
+    --shard.partialCount;
+}
@@ -0,0 +1,162 @@
+#include <cstring>
+
+#include "FileEntryIndex.h"
+#include "NamePool.h"
+#include "fileentry.h"
+
+// initial number of slots, must be power of two
+static const size_t INITIAL_SLOTS = 16;
+
+FileEntryIndex::FileEntryIndex() : slots(INITIAL_SLOTS, Slot{0, nullptr}),
+                                   mask(INITIAL_SLOTS - 1), count(0) {}
+
+uint64_t FileEntryIndex::hashName(const char *name, size_t length) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = 0x8445d61a4e774912ULL ^ (length * m);
+
+    auto data = reinterpret_cast<const unsigned char *>(name);
+    auto end = data + (length / 8) * 8;
+    for (; data != end; data += 8) {
+        uint64_t k;
+        memcpy(&k, data, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (length & 7) {
+        case 7: h ^= uint64_t(data[6]) << 48; // fall through
+        case 6: h ^= uint64_t(data[5]) << 40; // fall through
+        case 5: h ^= uint64_t(data[4]) << 32; // fall through
+        case 4: h ^= uint64_t(data[3]) << 24; // fall through
+        case 3: h ^= uint64_t(data[2]) << 16; // fall through
+        case 2: h ^= uint64_t(data[1]) << 8; // fall through
+        case 1: h ^= uint64_t(data[0]);
+            h *= m; // fall through
+        default:
+            break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+uint64_t FileEntryIndex::slotHash(const FileEntry *parent, uint64_t nameHash) {
+    // entries never move in memory, so address of parent identifies it
+    // finalizer of splitmix64 spreads address bits before they are mixed with name hash
+    auto h = uint64_t(reinterpret_cast<uintptr_t>(parent));
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h ^ nameHash;
+}
+
+FileEntry *FileEntryIndex::find(const FileEntry *parent, const char *name, size_t length) const {
+    // if name is not in pool, there is no entry with such name at all
+    auto nameId = NamePool::find(name, length);
+    if (nameId == NamePool::invalidId)
+        return nullptr;
+    return find(parent, nameId);
+}
+
+FileEntry *FileEntryIndex::find(const FileEntry *parent, uint32_t nameId) const {
+    auto hash = slotHash(parent, NamePool::getHash(nameId));
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        auto &slot = slots[i];
+        if (!slot.entry)
+            return nullptr;
+        if (slot.hash == hash && slot.entry->getParent() == parent && slot.entry->getNameId() == nameId)
+            return slot.entry;
+    }
+}
+
+void FileEntryIndex::insert(FileEntry *entry) {
+    if (!entry)
+        return;
+
+    // keep load factor below 3/4 so probe sequences stay short
+    if ((count + 1) * 4 > slots.size() * 3)
+        rehash(slots.size() * 2);
+
+    auto hash = slotHash(entry->getParent(), NamePool::getHash(entry->getNameId()));
+
+    auto i = hash & mask;
+    while (slots[i].entry)
+        i = (i + 1) & mask;
+    slots[i].hash = hash;
+    slots[i].entry = entry;
+    ++count;
+}
+
+bool FileEntryIndex::remove(const FileEntry *entry) {
+    if (!entry)
+        return false;
+
+    auto hash = slotHash(entry->getParent(), NamePool::getHash(entry->getNameId()));
+
+    auto i = hash & mask;
+    while (slots[i].entry != entry) {
+        if (!slots[i].entry)
+            return false;
+        i = (i + 1) & mask;
+    }
+
+    // shift following entries back so there are no gaps in their probe sequences
+    // this way we don't need tombstones and lookups don't degrade after many removals
+    auto j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!slots[j].entry)
+            break;
+        auto home = slots[j].hash & mask;
+        // entry at j can't be moved to i if its home slot is cyclically in (i, j]
+        bool inRange = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (inRange)
+            continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i].hash = 0;
+    slots[i].entry = nullptr;
+    --count;
+    return true;
+}
+
+size_t FileEntryIndex::size() const {
+    return count;
+}
+
+void FileEntryIndex::reserve(size_t entryCount) {
+    auto slotCount = slots.size();
+    while (entryCount * 4 > slotCount * 3)
+        slotCount *= 2;
+    if (slotCount != slots.size())
+        rehash(slotCount);
+}
+
+void FileEntryIndex::rehash(size_t slotCount) {
+    std::vector<Slot> newSlots(slotCount, Slot{0, nullptr});
+    auto newMask = newSlots.size() - 1;
+
+    for (auto &slot : slots) {
+        if (!slot.entry)
+            continue;
+        auto i = slot.hash & newMask;
+        while (newSlots[i].entry)
+            i = (i + 1) & newMask;
+        newSlots[i] = slot;
+    }
+
+    slots.swap(newSlots);
+    mask = newMask;
+}
@@ -0,0 +1,157 @@
+#include "HardLinkSet.h"
+
+// top bits of hash select shard, lower bits select slot inside of it
+static const unsigned SHARD_SHIFT = 58;
+static const size_t INITIAL_SHARD_SLOTS = 64;
+
+HardLinkSet::HardLinkSet(size_t maxEntries) :
+        maxShardEntries((maxEntries + SHARD_COUNT - 1) / SHARD_COUNT) {}
+
+uint64_t HardLinkSet::hashId(uint64_t device, uint64_t inode) {
+    // splitmix64 finalizer
+    uint64_t h = inode ^ (device * 0x9E3779B97F4A7C15ull);
+    h ^= h >> 30u;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27u;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31u;
+    // zero marks empty slots
+    return h == 0 ? 1 : h;
+}
+
+bool HardLinkSet::claim(uint64_t device, uint64_t inode, uint32_t owner, const std::string &linkDir) {
+    auto key = hashId(device, inode);
+    auto &shard = shards[key >> SHARD_SHIFT];
+
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (shard.slots.empty())
+        shard.slots.resize(INITIAL_SHARD_SLOTS, Slot{0, 0});
+
+    auto mask = shard.slots.size() - 1;
+    for (auto i = size_t(key) & mask;; i = (i + 1) & mask) {
+        auto &slot = shard.slots[i];
+        if (slot.key == key) {
+            if (slot.owner == owner)
+                return true;
+            if (!linkDir.empty()) {
+                std::lock_guard<std::mutex> ownersLock(ownersMtx);
+                waitingDirs[key] = linkDir;
+            }
+            return false;
+        }
+        if (slot.key != 0)
+            continue;
+
+        // file is not known yet
+        if (shard.count >= maxShardEntries)
+            return true;
+        slot.key = key;
+        slot.owner = owner;
+        ++shard.count;
+        if (shard.count * 4 > shard.slots.size() * 3)
+            grow(shard);
+
+        std::lock_guard<std::mutex> ownersLock(ownersMtx);
+        ownedKeys.emplace(owner, key);
+        return true;
+    }
+}
+
+void HardLinkSet::release(uint32_t owner, std::vector<std::string> &linkDirs) {
+    // claim() locks owners while shard is locked, so here they are never locked at the same time
+    std::vector<uint64_t> keys;
+    {
+        std::lock_guard<std::mutex> lock(ownersMtx);
+        auto range = ownedKeys.equal_range(owner);
+        for (auto it = range.first; it != range.second; ++it)
+            keys.push_back(it->second);
+        ownedKeys.erase(range.first, range.second);
+    }
+
+    for (auto it = keys.begin(); it != keys.end();) {
+        auto &shard = shards[*it >> SHARD_SHIFT];
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if (removeOwned(shard, *it, owner))
+            ++it;
+        else
+            it = keys.erase(it); // file was already released
+    }
+
+    std::lock_guard<std::mutex> lock(ownersMtx);
+    for (auto key : keys) {
+        auto it = waitingDirs.find(key);
+        if (it != waitingDirs.end()) {
+            linkDirs.push_back(std::move(it->second));
+            waitingDirs.erase(it);
+        }
+    }
+}
+
+void HardLinkSet::clear() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        std::vector<Slot>().swap(shard.slots);
+        shard.count = 0;
+    }
+    std::lock_guard<std::mutex> lock(ownersMtx);
+    ownedKeys.clear();
+    waitingDirs.clear();
+}
+
+size_t HardLinkSet::size() const {
+    size_t count = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        count += shard.count;
+    }
+    return count;
+}
+
+bool HardLinkSet::empty() const {
+    std::lock_guard<std::mutex> lock(ownersMtx);
+    return ownedKeys.empty();
+}
+
+void HardLinkSet::grow(Shard &shard) {
+    std::vector<Slot> oldSlots(shard.slots.size() * 2, Slot{0, 0});
+    oldSlots.swap(shard.slots);
+
+    auto mask = shard.slots.size() - 1;
+    for (auto &slot : oldSlots) {
+        if (slot.key == 0)
+            continue;
+        auto i = size_t(slot.key) & mask;
+        while (shard.slots[i].key != 0)
+            i = (i + 1) & mask;
+        shard.slots[i] = slot;
+    }
+}
+
+bool HardLinkSet::removeOwned(Shard &shard, uint64_t key, uint32_t owner) {
+    if (shard.slots.empty())
+        return false;
+
+    auto mask = shard.slots.size() - 1;
+    auto i = size_t(key) & mask;
+    while (shard.slots[i].key != key) {
+        if (shard.slots[i].key == 0)
+            return false;
+        i = (i + 1) & mask;
+    }
+    if (shard.slots[i].owner != owner)
+        return false;
+
+    // entries after removed one are shifted back, so none of them is separated from its home slot
+    for (auto j = (i + 1) & mask; shard.slots[j].key != 0; j = (j + 1) & mask) {
+        auto home = size_t(shard.slots[j].key) & mask;
+        // entry can be moved to i only if i is between its home slot and j (cyclically)
+        bool canMove = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (canMove) {
+            shard.slots[i] = shard.slots[j];
+            i = j;
+        }
+    }
+    shard.slots[i] = Slot{0, 0};
+    --shard.count;
+    return true;
+}
@@ -0,0 +1,216 @@
+#include "NamePool.h"
+#include "SlabPool.h"
+#include "FileEntryIndex.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+    // records are stored in chunks that never move, so names can be read without locks
+    const unsigned CHUNK_BITS = 16;
+    const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    const size_t MAX_CHUNKS = size_t(1) << 14;
+    // top bits of hash select shard, lower bits select slot inside of it
+    const unsigned SHARD_SHIFT = 58;
+    const size_t SHARD_COUNT = 64;
+    const size_t INITIAL_SHARD_SLOTS = 64;
+
+    struct Record {
+        char *name;
+        uint64_t hash;
+        // protected by mutex of shard that holds this name
+        uint32_t refCount;
+        uint32_t length;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        // ids of names, 0 marks empty slot
+        std::vector<uint32_t> slots;
+        size_t count = 0;
+    };
+
+    struct Pool {
+        std::atomic<Record *> chunks[MAX_CHUNKS];
+        Shard shards[SHARD_COUNT];
+
+        // protects ids that are not used by any name
+        std::mutex idMtx;
+        std::vector<uint32_t> freeIds;
+        uint32_t nextId;
+
+        std::atomic<size_t> nameCount;
+
+        Pool() : nextId(NamePool::invalidId + 1), nameCount(0) {
+            for (auto &chunk : chunks)
+                chunk.store(nullptr);
+        }
+    };
+
+    Pool &getPool() {
+        // never destroyed, since names might be released during destruction of other static objects
+        static Pool *pool = new Pool();
+        return *pool;
+    }
+
+    Record &getRecord(Pool &pool, uint32_t id) {
+        return pool.chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+    }
+
+    uint32_t allocateId(Pool &pool) {
+        std::lock_guard<std::mutex> lock(pool.idMtx);
+        if (!pool.freeIds.empty()) {
+            auto id = pool.freeIds.back();
+            pool.freeIds.pop_back();
+            return id;
+        }
+
+        auto chunkIndex = size_t(pool.nextId) >> CHUNK_BITS;
+        if (chunkIndex >= MAX_CHUNKS)
+            throw std::bad_alloc();
+        if (!pool.chunks[chunkIndex].load(std::memory_order_relaxed))
+            pool.chunks[chunkIndex].store(new Record[CHUNK_SIZE], std::memory_order_release);
+        return pool.nextId++;
+    }
+
+    void freeId(Pool &pool, uint32_t id) {
+        std::lock_guard<std::mutex> lock(pool.idMtx);
+        pool.freeIds.push_back(id);
+    }
+
+    bool isSameName(const Record &record, uint64_t hash, const char *name, size_t length) {
+        return record.hash == hash && record.length == length && memcmp(record.name, name, length) == 0;
+    }
+
+    /**
+     * Doubles number of slots in shard and reinserts all names
+     */
+    void grow(Pool &pool, Shard &shard) {
+        std::vector<uint32_t> oldSlots(shard.slots.size() * 2, NamePool::invalidId);
+        oldSlots.swap(shard.slots);
+
+        auto mask = shard.slots.size() - 1;
+        for (auto id : oldSlots) {
+            if (id == NamePool::invalidId)
+                continue;
+            auto i = size_t(getRecord(pool, id).hash) & mask;
+            while (shard.slots[i] != NamePool::invalidId)
+                i = (i + 1) & mask;
+            shard.slots[i] = id;
+        }
+    }
+}
+
+uint32_t NamePool::acquire(const char *name, size_t length) {
+    auto &pool = getPool();
+    auto hash = FileEntryIndex::hashName(name, length);
+    auto &shard = pool.shards[hash >> SHARD_SHIFT];
+
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (shard.slots.empty())
+        shard.slots.resize(INITIAL_SHARD_SLOTS, invalidId);
+
+    auto mask = shard.slots.size() - 1;
+    auto i = size_t(hash) & mask;
+    for (; shard.slots[i] != invalidId; i = (i + 1) & mask) {
+        auto &record = getRecord(pool, shard.slots[i]);
+        if (isSameName(record, hash, name, length)) {
+            ++record.refCount;
+            return shard.slots[i];
+        }
+    }
+
+    // name is not known yet
+    auto id = allocateId(pool);
+    auto &record = getRecord(pool, id);
+    record.name = static_cast<char *>(SlabPool::allocate(length + 1));
+    memcpy(record.name, name, length);
+    record.name[length] = '\0';
+    record.hash = hash;
+    record.refCount = 1;
+    record.length = uint32_t(length);
+
+    shard.slots[i] = id;
+    ++shard.count;
+    if (shard.count * 4 > shard.slots.size() * 3)
+        grow(pool, shard);
+    ++pool.nameCount;
+    return id;
+}
+
+void NamePool::release(uint32_t id) {
+    if (id == invalidId)
+        return;
+
+    auto &pool = getPool();
+    auto &record = getRecord(pool, id);
+    auto &shard = pool.shards[record.hash >> SHARD_SHIFT];
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if (--record.refCount != 0)
+            return;
+
+        auto mask = shard.slots.size() - 1;
+        auto i = size_t(record.hash) & mask;
+        while (shard.slots[i] != id)
+            i = (i + 1) & mask;
+
+        // shift following names back so there are no gaps in their probe sequences
+        auto j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (shard.slots[j] == invalidId)
+                break;
+            auto home = size_t(getRecord(pool, shard.slots[j]).hash) & mask;
+            // name at j can't be moved to i if its home slot is cyclically in (i, j]
+            bool inRange = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (inRange)
+                continue;
+            shard.slots[i] = shard.slots[j];
+            i = j;
+        }
+        shard.slots[i] = invalidId;
+        --shard.count;
+
+        SlabPool::deallocate(record.name, record.length + 1);
+        record.name = nullptr;
+    }
+    --pool.nameCount;
+    freeId(pool, id);
+}
+
+uint32_t NamePool::find(const char *name, size_t length) {
+    auto &pool = getPool();
+    auto hash = FileEntryIndex::hashName(name, length);
+    auto &shard = pool.shards[hash >> SHARD_SHIFT];
+
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (shard.slots.empty())
+        return invalidId;
+
+    auto mask = shard.slots.size() - 1;
+    for (auto i = size_t(hash) & mask; shard.slots[i] != invalidId; i = (i + 1) & mask) {
+        if (isSameName(getRecord(pool, shard.slots[i]), hash, name, length))
+            return shard.slots[i];
+    }
+    return invalidId;
+}
+
+const char *NamePool::getName(uint32_t id) {
+    return getRecord(getPool(), id).name;
+}
+
+size_t NamePool::getLength(uint32_t id) {
+    return getRecord(getPool(), id).length;
+}
+
+uint64_t NamePool::getHash(uint32_t id) {
+    return getRecord(getPool(), id).hash;
+}
+
+size_t NamePool::getNameCount() {
+    return getPool().nameCount;
+}
@@ -0,0 +1,98 @@
+#include "ScanQueue.h"
+#include "filepath.h"
+
+ScanQueue::ScanQueue() = default;
+
+ScanQueue::~ScanQueue() = default;
+
+void ScanQueue::push(std::unique_ptr<FilePath> path, bool recursive, bool quick, bool toBack) {
+    if (!path)
+        return;
+
+    Node *node = &root;
+    for (auto &part : path->getParts()) {
+        // request of parent covers this request if parent is scanned recursively and not less thoroughly
+        if (node->isQueued && node->request.recursive && (quick || !node->request.quick))
+            return;
+
+        auto &child = node->children[part];
+        if (!child) {
+            child = std::unique_ptr<Node>(new Node());
+            child->parent = node;
+            child->name = part;
+        }
+        node = child.get();
+    }
+
+    if (node->isQueued) {
+        // merge with existing request, so nothing that was requested is lost
+        recursive = recursive || node->request.recursive;
+        quick = quick && node->request.quick;
+        unqueue(*node);
+    }
+
+    if (recursive)
+        removeDescendants(*node, quick);
+
+    node->isQueued = true;
+    node->request.path = std::move(path);
+    node->request.recursive = recursive;
+    node->request.quick = quick;
+    node->orderIt = toBack ? order.insert(order.end(), node) : order.insert(order.begin(), node);
+}
+
+bool ScanQueue::pop(Request &request) {
+    if (order.empty())
+        return false;
+
+    auto node = order.front();
+    request = std::move(node->request);
+    unqueue(*node);
+    prune(node);
+    return true;
+}
+
+void ScanQueue::clear() {
+    order.clear();
+    root.children.clear();
+    root.isQueued = false;
+}
+
+bool ScanQueue::empty() const {
+    return order.empty();
+}
+
+size_t ScanQueue::size() const {
+    return order.size();
+}
+
+void ScanQueue::unqueue(Node &node) {
+    order.erase(node.orderIt);
+    node.isQueued = false;
+    node.request.path = nullptr;
+}
+
+void ScanQueue::removeDescendants(Node &node, bool quick) {
+    auto it = node.children.begin();
+    while (it != node.children.end()) {
+        auto &child = *it->second;
+        if (child.isQueued && (!quick || child.request.quick))
+            unqueue(child);
+        removeDescendants(child, quick);
+
+        if (!child.isQueued && child.children.empty())
+            it = node.children.erase(it);
+        else
+            ++it;
+    }
+}
+
+void ScanQueue::prune(Node *node) {
+    while (node != &root && !node->isQueued && node->children.empty()) {
+        auto parent = node->parent;
+        auto name = node->name;
+        // this deletes node
+        parent->children.erase(name);
+        node = parent;
+    }
+}
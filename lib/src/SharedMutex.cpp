@@ -0,0 +1,47 @@
+#include "SharedMutex.h"
+
+SharedMutex::SharedMutex() : activeReaders(0), waitingWriters(0), hasWriter(false) {}
+
+void SharedMutex::lock() {
+    std::unique_lock<std::mutex> lock(mtx);
+    ++waitingWriters;
+    writersCv.wait(lock, [this]() { return !hasWriter && activeReaders == 0; });
+    --waitingWriters;
+    hasWriter = true;
+}
+
+bool SharedMutex::try_lock() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (hasWriter || activeReaders > 0 || waitingWriters > 0)
+        return false;
+    hasWriter = true;
+    return true;
+}
+
+void SharedMutex::unlock() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        hasWriter = false;
+    }
+    // next writer is preferred but readers should be woken up too,
+    // they will go back to sleep if some writer is still waiting
+    writersCv.notify_one();
+    readersCv.notify_all();
+}
+
+void SharedMutex::lock_shared() {
+    std::unique_lock<std::mutex> lock(mtx);
+    readersCv.wait(lock, [this]() { return !hasWriter && waitingWriters == 0; });
+    ++activeReaders;
+}
+
+void SharedMutex::unlock_shared() {
+    bool isLast;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        --activeReaders;
+        isLast = activeReaders == 0;
+    }
+    if (isLast)
+        writersCv.notify_one();
+}
@@ -0,0 +1,204 @@
+#include "SlabPool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+    // slabs are aligned to their size, so slab of any object can be found from its pointer
+    const size_t SLAB_SIZE = 64 * 1024;
+    const size_t SIZE_GRANULARITY = 8;
+    const size_t SIZE_CLASS_COUNT = SlabPool::maxSlabObjectSize / SIZE_GRANULARITY;
+    // each size class is split into shards so threads don't fight for the same mutex
+    const size_t SHARD_COUNT = 8;
+
+    struct Shard;
+
+    /**
+     * Header of slab. Objects are stored right after it.
+     */
+    struct Slab {
+        Shard *shard;
+        // slab is in the list of shard only when it has free slots
+        Slab *prev;
+        Slab *next;
+        bool isListed;
+        // singly linked list of freed slots (pointer to next is stored inside slot)
+        void *freeList;
+        // slots after this number were never used, so they are not in free list
+        uint32_t bumpedCount;
+        uint32_t usedCount;
+        uint32_t capacity;
+    };
+
+    const size_t SLAB_HEADER_SIZE = (sizeof(Slab) + 15) & ~size_t(15);
+
+    struct Shard {
+        std::mutex mtx;
+        size_t objectSize = 0;
+        // list of slabs that have free slots
+        Slab *partialSlabs = nullptr;
+        size_t partialCount = 0;
+    };
+
+    struct SizeClass {
+        Shard shards[SHARD_COUNT];
+    };
+
+    std::atomic<int64_t> reservedSize(0);
+    std::atomic<int64_t> usedSize(0);
+    std::atomic<size_t> shardCounter(0);
+
+    SizeClass *getSizeClasses() {
+        // never destroyed, since objects might be freed during destruction of other static objects
+        static SizeClass *sizeClasses = []() {
+            auto classes = new SizeClass[SIZE_CLASS_COUNT];
+            for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+                for (auto &shard : classes[i].shards)
+                    shard.objectSize = (i + 1) * SIZE_GRANULARITY;
+            }
+            return classes;
+        }();
+        return sizeClasses;
+    }
+
+    size_t getThreadShard() {
+        static thread_local size_t shard = shardCounter++ % SHARD_COUNT;
+        return shard;
+    }
+
+    size_t getSizeClass(size_t size) {
+        return size == 0 ? 0 : (size - 1) / SIZE_GRANULARITY;
+    }
+
+    void *allocateSlabMemory() {
+#ifdef _WIN32
+        return _aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+#else
+        void *ptr;
+        if (posix_memalign(&ptr, SLAB_SIZE, SLAB_SIZE) != 0)
+            return nullptr;
+        return ptr;
+#endif
+    }
+
+    void freeSlabMemory(void *ptr) {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    void listSlab(Shard &shard, Slab *slab) {
+        slab->prev = nullptr;
+        slab->next = shard.partialSlabs;
+        if (shard.partialSlabs)
+            shard.partialSlabs->prev = slab;
+        shard.partialSlabs = slab;
+        slab->isListed = true;
+        ++shard.partialCount;
+    }
+
+    void unlistSlab(Shard &shard, Slab *slab) {
+        if (slab->prev)
+            slab->prev->next = slab->next;
+        else
+            shard.partialSlabs = slab->next;
+        if (slab->next)
+            slab->next->prev = slab->prev;
+        slab->prev = nullptr;
+        slab->next = nullptr;
+        slab->isListed = false;
+        --shard.partialCount;
+    }
+
+    Slab *createSlab(Shard &shard) {
+        auto memory = allocateSlabMemory();
+        if (!memory)
+            return nullptr;
+        auto slab = static_cast<Slab *>(memory);
+        slab->shard = &shard;
+        slab->prev = nullptr;
+        slab->next = nullptr;
+        slab->isListed = false;
+        slab->freeList = nullptr;
+        slab->bumpedCount = 0;
+        slab->usedCount = 0;
+        slab->capacity = uint32_t((SLAB_SIZE - SLAB_HEADER_SIZE) / shard.objectSize);
+        reservedSize += SLAB_SIZE;
+        return slab;
+    }
+}
+
+void *SlabPool::allocate(size_t size) {
+    if (size > maxSlabObjectSize)
+        return ::operator new(size);
+
+    auto &shard = getSizeClasses()[getSizeClass(size)].shards[getThreadShard()];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto slab = shard.partialSlabs;
+    if (!slab) {
+        slab = createSlab(shard);
+        if (!slab)
+            throw std::bad_alloc();
+        listSlab(shard, slab);
+    }
+
+    void *ptr;
+    if (slab->freeList) {
+        ptr = slab->freeList;
+        slab->freeList = *static_cast<void **>(ptr);
+    } else {
+        ptr = reinterpret_cast<char *>(slab) + SLAB_HEADER_SIZE + slab->bumpedCount * shard.objectSize;
+        ++slab->bumpedCount;
+    }
+    ++slab->usedCount;
+    if (slab->usedCount == slab->capacity)
+        unlistSlab(shard, slab);
+
+    usedSize += shard.objectSize;
+    return ptr;
+}
+
+void SlabPool::deallocate(void *ptr, size_t size) {
+    if (!ptr)
+        return;
+    if (size > maxSlabObjectSize) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    auto slab = reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(SLAB_SIZE - 1));
+    auto &shard = *slab->shard;
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    *static_cast<void **>(ptr) = slab->freeList;
+    slab->freeList = ptr;
+    --slab->usedCount;
+    usedSize -= shard.objectSize;
+
+    if (!slab->isListed)
+        listSlab(shard, slab);
+
+    // keep at least one slab in shard, so we don't create and free slab
+    // when the same object is allocated and freed repeatedly
+    if (slab->usedCount == 0 && shard.partialCount > 1) {
+        unlistSlab(shard, slab);
+        freeSlabMemory(slab);
+        reservedSize -= SLAB_SIZE;
+    }
+}
+
+int64_t SlabPool::getReservedSize() {
+    return reservedSize;
+}
+
+int64_t SlabPool::getUsedSize() {
+    return usedSize;
+}
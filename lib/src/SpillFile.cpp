@@ -0,0 +1,130 @@
+#include "SpillFile.h"
+#include "MappedFile.h"
+#include "utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+SpillFile::SpillFile(const std::string &path_) :
+        path(path_), file(path_, std::ios::binary | std::ios::trunc), fileSize(0),
+        releasedBytes(0) {
+    if (!file)
+        throw std::runtime_error(Utils::strFormat("Can't create %s", path.c_str()));
+}
+
+SpillFile::~SpillFile() {
+    // file can't be removed on windows while it is open or mapped
+    mapped.reset();
+    file.close();
+    std::remove(path.c_str());
+}
+
+uint64_t SpillFile::write(const void *data, size_t size) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // the smallest released range that fits, so big ranges are left for big blocks
+    auto offset = fileSize;
+    auto sizeIt = releasedBySize.lower_bound(std::make_pair(uint64_t(size), uint64_t(0)));
+    bool isReused = size > 0 && sizeIt != releasedBySize.end();
+    if (isReused)
+        offset = sizeIt->second;
+
+    file.seekp(std::streamoff(offset));
+    file.write(static_cast<const char *>(data), std::streamsize(size));
+    if (!file)
+        throw std::runtime_error(Utils::strFormat("Can't write to %s", path.c_str()));
+
+    if (isReused) {
+        auto rangeSize = sizeIt->first;
+        removeReleased(releasedByOffset.find(offset));
+        if (rangeSize > size)
+            addReleased(offset + size, rangeSize - size);
+        // mapping might still have old data
+        if (mapped && mapped->size() > offset)
+            mapped.reset();
+    } else
+        fileSize += size;
+    return offset;
+}
+
+void SpillFile::release(uint64_t offset, size_t size) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (size == 0 || offset > fileSize || size > fileSize - offset)
+        return;
+    addReleased(offset, size);
+}
+
+bool SpillFile::read(uint64_t offset, void *dest, size_t size) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!mapRange(offset, size))
+        return false;
+    if (size > 0)
+        memcpy(dest, mapped->data() + offset, size);
+    return true;
+}
+
+bool SpillFile::view(uint64_t offset, size_t size, const std::function<void(const char *)> &reader) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!mapRange(offset, size))
+        return false;
+    reader(size > 0 ? reinterpret_cast<const char *>(mapped->data()) + offset : nullptr);
+    return true;
+}
+
+bool SpillFile::mapRange(uint64_t offset, size_t size) {
+    if (offset > fileSize || size > fileSize - offset)
+        return false;
+    if (size == 0)
+        return true;
+
+    if (!mapped || mapped->size() < offset + size) {
+        // mapping covers only data that was written before it was created
+        mapped.reset();
+        file.flush();
+        try {
+            mapped = Utils::make_unique<MappedFile>(path);
+        } catch (std::exception &) {
+            return false;
+        }
+        if (mapped->size() < offset + size)
+            return false;
+    }
+    return true;
+}
+
+uint64_t SpillFile::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return fileSize;
+}
+
+uint64_t SpillFile::releasedSize() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return releasedBytes;
+}
+
+void SpillFile::addReleased(uint64_t offset, uint64_t size) {
+    // merge with neighbours, so big blocks can reuse space of several small ones
+    auto next = releasedByOffset.lower_bound(offset);
+    if (next != releasedByOffset.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            removeReleased(prev);
+        }
+    }
+    if (next != releasedByOffset.end() && offset + size == next->first) {
+        size += next->second;
+        removeReleased(next);
+    }
+    releasedByOffset[offset] = size;
+    releasedBySize.insert(std::make_pair(size, offset));
+    releasedBytes += size;
+}
+
+void SpillFile::removeReleased(std::map<uint64_t, uint64_t>::iterator it) {
+    releasedBySize.erase(std::make_pair(it->second, it->first));
+    releasedBytes -= it->second;
+    releasedByOffset.erase(it);
+}
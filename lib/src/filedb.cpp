@@ -1,42 +1,272 @@
 #include <iostream>
+#include <fstream>
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
 #include "filedb.h"
 
 #include "filepath.h"
 #include "fileentry.h"
+#include "MappedFile.h"
+#include "SpillFile.h"
 #include "platformutils.h"
 #include "utils.h"
 
-extern "C" {
-#include <crc.h>
+namespace {
+    const char SNAPSHOT_MAGIC[8] = {'S', 'D', 'S', 'N', 'A', 'P', '\r', '\n'};
+    const uint32_t SNAPSHOT_VERSION = 5;
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        // size of SnapshotNode, protects from loading snapshot made with incompatible layout
+        uint32_t nodeSize;
+        uint64_t nodeCount;
+        uint64_t namesSize;
+        int64_t totalSpace;
+        int64_t availableSpace;
+        uint64_t stampCount;
+        uint64_t aggregateCount;
+        // value of SizeMode
+        uint32_t sizeMode;
+        uint32_t reserved;
+    };
+
+    /**
+     * Entries are stored in depth-first order, children of each entry
+     * follow it (in decreasing order of size)
+     */
+    struct SnapshotNode {
+        int64_t size;
+        // offset of name in names table (names are not null-terminated)
+        uint64_t nameOffset;
+        uint32_t childCount;
+        uint16_t nameLength;
+        uint8_t isDir;
+        uint8_t reserved;
+    };
+
+    /**
+     * Stamps of directories are stored after names in the same order as nodes
+     */
+    struct SnapshotStamp {
+        uint64_t nodeIndex;
+        int64_t modifyTime;
+        int64_t changeTime;
+        uint64_t inode;
+        uint64_t mountId;
+    };
+
+    /**
+     * Totals of aggregated directories are stored after stamps in the same order as nodes
+     */
+    struct SnapshotAggregate {
+        uint64_t nodeIndex;
+        int64_t size;
+        int64_t fileCount;
+        int64_t dirCount;
+    };
+
+    SnapshotStamp toSnapshotStamp(uint64_t nodeIndex, const PlatformUtils::DirStamp &stamp) {
+        return SnapshotStamp{nodeIndex, stamp.modifyTime, stamp.changeTime, stamp.inode, stamp.mountId};
+    }
+
+    PlatformUtils::DirStamp fromSnapshotStamp(const SnapshotStamp &stamp) {
+        return PlatformUtils::DirStamp{stamp.modifyTime, stamp.changeTime, stamp.inode, stamp.mountId};
+    }
+
+    // estimated memory of one entry: entry itself, reference to it in its parent
+    // and its slot in index (index is about half full)
+    const int64_t ENTRY_MEMORY_SIZE = sizeof(FileEntry) + sizeof(uint32_t) + 2 * (sizeof(uint64_t) + sizeof(void *));
+    // children of root are never spilled, so the top level of tree always stays detailed
+    const int SPILL_MIN_DEPTH = 2;
+    // smaller subtrees are not worth writing to spill file
+    const int64_t SPILL_MIN_ENTRIES = 16;
+
+    int64_t countEntries(const FileEntry &entry) {
+        int64_t count = 0;
+        entry.forEach([&count](const FileEntry &child) -> bool {
+            count += 1 + countEntries(child);
+            return true;
+        });
+        return count;
+    }
+
+    /**
+     * Restores entries that are stored in depth-first order as children of parent.
+     * Each restored entry is passed to onEntry together with index of its node.
+     * @param parent
+     * @param childCount - number of direct children of parent
+     * @param firstNode - index of the first node
+     * @param endNode - index after the last node
+     * @param readNode - reads node with given index, returns false if node is not valid
+     * @param names - table of names
+     * @param onEntry
+     * @return false if nodes don't form a valid tree
+     */
+    bool restoreChildren(FileEntry *parent, uint32_t childCount, uint64_t firstNode, uint64_t endNode,
+                         const std::function<bool(uint64_t, SnapshotNode &)> &readNode, const char *names,
+                         const std::function<void(FileEntry *, uint64_t)> &onEntry) {
+        // entries that still wait for their children and how many children are left
+        std::vector<std::pair<FileEntry *, uint32_t>> parents;
+        if (childCount > 0)
+            parents.emplace_back(parent, childCount);
+
+        SnapshotNode node{};
+        for (uint64_t i = firstNode; i < endNode; ++i) {
+            if (parents.empty() || !readNode(i, node))
+                return false;
+
+            auto nodeParent = parents.back().first;
+            if (--parents.back().second == 0)
+                parents.pop_back();
+
+            auto entry = FileEntry::create(std::string(names + node.nameOffset, node.nameLength),
+                                           node.isDir != 0, node.size);
+            auto ePtr = entry.get();
+            nodeParent->restoreChild(std::move(entry));
+            onEntry(ePtr, i);
+
+            if (node.isDir && node.childCount > 0)
+                parents.emplace_back(ePtr, node.childCount);
+        }
+        return parents.empty();
+    }
+
+    /**
+     * Adds path to entry (if it is a file) or paths to all files inside of it
+     * @param entry
+     * @param parentPath - path to parent of entry
+     * @param files - where to add paths
+     */
+    void collectFiles(const FileEntry &entry, const FilePath &parentPath,
+                      std::vector<std::unique_ptr<FilePath>> &files) {
+        auto path = Utils::make_unique<FilePath>(parentPath);
+        if (!entry.isDir()) {
+            path->addFile(entry.getName(), entry.getNameCrc());
+            files.push_back(std::move(path));
+            return;
+        }
+        path->addDir(entry.getName(), entry.getNameCrc());
+        entry.forEach([&path, &files](const FileEntry &child) -> bool {
+            collectFiles(child, *path, files);
+            return true;
+        });
+    }
 }
 
-FileDB::FileDB(const std::string &path) : bHasChanges(true), usedSpace(0),
-                   fileCount(0), dirCount(1) {
+FileDB::FileDB(const std::string &path, SizeMode sizeMode_) :
+        totalSpace(0), availableSpace(0), sizeMode(sizeMode_), usedSpace(0), fileCount(0), dirCount(1),
+        spilledCount(0), bHasChanges(true), memoryBudget(0), nextSpillUsage(0), recentlyLoaded(nullptr) {
     rootPath = Utils::make_unique<FilePath>(path);
-    rootFile = Utils::make_unique<FileEntry>(rootPath->getPath(), true);
+    rootFile = FileEntry::create(rootPath->getPath(), true);
 }
 
+FileDB::~FileDB() = default;
+
+FileDB::ChildrenUpdate::ChildrenUpdate(std::unique_ptr<FilePath> path_,
+                                       std::vector<std::unique_ptr<FileEntry>> entries_,
+                                       bool collectNewPaths_) :
+        path(std::move(path_)), entries(std::move(entries_)),
+        collectNewPaths(collectNewPaths_), collectDeletedPaths(false), collectDeletedFiles(false),
+        isSorted(false),
+        hasStamp(false), stamp(), hasAggregate(false), aggregate() {}
+
 void FileDB::setSpace(int64_t totalSpace_, int64_t availableSpace_) {
     totalSpace = totalSpace_;
     availableSpace = availableSpace_;
 }
 
+void FileDB::sortEntries(std::vector<std::unique_ptr<FileEntry>> &entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const std::unique_ptr<FileEntry> &e1, const std::unique_ptr<FileEntry> &e2) {
+                  return e1->getSize() > e2->getSize();
+              });
+}
+
 bool FileDB::setChildrenForPath(const FilePath &path,
                                 std::vector<std::unique_ptr<FileEntry>> entries,
                                 std::vector<std::unique_ptr<FilePath>> *newPaths) {
     if (!path.isDir())
         return false;
     // Presorting entries by size so we can insert them much quicker
-    std::sort(entries.begin(), entries.end(),
-              [](const std::unique_ptr<FileEntry> &e1, const std::unique_ptr<FileEntry> &e2) {
-                  return e1->getSize() > e2->getSize();
-              });
-    std::lock_guard<std::mutex> lock(dbMtx);
+    sortEntries(entries);
+    std::lock_guard<SharedMutex> lock(dbMtx);
 
+    auto isSet = _setChildrenForPath(path, entries, newPaths);
+    _spillIfNeeded();
+    return isSet;
+}
+
+bool FileDB::setChildrenForPaths(std::vector<ChildrenUpdate> &updates, bool wait) {
+    if (updates.empty())
+        return true;
+
+    // sort everything before db is locked
+    for (auto &update : updates) {
+        if (!update.isSorted) {
+            sortEntries(update.entries);
+            update.isSorted = true;
+        }
+    }
+
+    std::unique_lock<SharedMutex> lock(dbMtx, std::defer_lock);
+    if (wait)
+        lock.lock();
+    else if (!lock.try_lock())
+        return false;
+
+    for (auto &update : updates) {
+        if (update.path->isDir())
+            _setChildrenForPath(*update.path, update.entries,
+                                update.collectNewPaths ? &update.newPaths : nullptr,
+                                update.hasStamp ? &update.stamp : nullptr,
+                                update.collectDeletedPaths ? &update.deletedPaths : nullptr,
+                                update.hasAggregate ? &update.aggregate : nullptr,
+                                update.collectDeletedFiles ? &update.deletedFiles : nullptr);
+        update.entries.clear();
+    }
+    _spillIfNeeded();
+
+    return true;
+}
+
+bool FileDB::_setChildrenForPath(const FilePath &path,
+                                 std::vector<std::unique_ptr<FileEntry>> &entries,
+                                 std::vector<std::unique_ptr<FilePath>> *newPaths,
+                                 const PlatformUtils::DirStamp *stamp,
+                                 std::vector<std::unique_ptr<FilePath>> *deletedPaths,
+                                 const Aggregate *aggregate,
+                                 std::vector<std::unique_ptr<FilePath>> *deletedFiles) {
+    if (!spilledDirs.empty())
+        _loadSpilledPath(path);
     auto parentEntry = _findEntry(path);
     if (!parentEntry)
         return false;
+    // directory couldn't be loaded, its spilled children are replaced by new ones
+    if (_dropSpilledEntry(parentEntry))
+        _updateSpillBlockers(parentEntry, -1);
+
+    if (memoryBudget > 0 && pendingDirs.erase(parentEntry) > 0)
+        _updateSpillBlockers(parentEntry, -1);
+
+    if (stamp)
+        dirStamps[parentEntry] = *stamp;
+    else
+        dirStamps.erase(parentEntry);
+
+    // all changes of children are applied to parents of this entry only once
+    auto sizeBefore = parentEntry->beginChildrenUpdate();
+
+    // previous totals of directory are replaced by its new children (or new totals)
+    auto aggregateIt = aggregates.find(parentEntry);
+    if (aggregateIt != aggregates.end()) {
+        parentEntry->setSize(parentEntry->getSize() - aggregateIt->second.size);
+        fileCount -= aggregateIt->second.fileCount;
+        dirCount -= aggregateIt->second.dirCount;
+        aggregates.erase(aggregateIt);
+        _updateSpillBlockers(parentEntry, -1);
+    }
 
     int deletedDirCount = 0;
     int deletedFileCount = 0;
@@ -45,7 +275,7 @@ bool FileDB::setChildrenForPath(const FilePath &path,
     parentEntry->markChildrenPendingDelete(deletedFileCount, deletedDirCount);
 
     for (auto &e : entries) {
-        auto existingChild = _findEntry(e->getName(), e->getNameCrc(), parentEntry);
+        auto existingChild = _findEntry(e->getNameId(), parentEntry);
 
         if (existingChild) {
             //child found, decide what to do with it. unmark it for deletion
@@ -67,11 +297,14 @@ bool FileDB::setChildrenForPath(const FilePath &path,
 
         auto ePtr = e.get();
         parentEntry->addChild(std::move(e));
-        auto crc = ePtr->getPathCrc(); //path crc will be correct after adding to parent
 
-        if (ePtr->isDir())
+        if (ePtr->isDir()) {
             ++dirCount;
-        else
+            if (memoryBudget > 0) {
+                pendingDirs.insert(ePtr);
+                _updateSpillBlockers(ePtr, 1);
+            }
+        } else
             ++fileCount;
 
         // if directory is added, it should be put into newPaths vector so it gets scanned
@@ -81,14 +314,7 @@ bool FileDB::setChildrenForPath(const FilePath &path,
             newPaths->push_back(std::move(childPath));
         }
 
-        //TODO move out of lock?
-        auto it2 = entriesMap.find(crc);
-        if (it2 != entriesMap.end())
-            it2->second.push_back(ePtr);
-        else {
-            std::vector<FileEntry *> vec{ePtr};
-            entriesMap[crc] = std::move(vec);
-        }
+        entriesIndex.insert(ePtr);
     }
 
     std::vector<std::unique_ptr<FileEntry>> deletedChildren;
@@ -97,13 +323,41 @@ bool FileDB::setChildrenForPath(const FilePath &path,
     if (deletedFileCount + deletedDirCount > 0)
         parentEntry->removePendingDelete(deletedChildren);
 
+    if (aggregate) {
+        parentEntry->setSize(parentEntry->getSize() + aggregate->size);
+        fileCount += aggregate->fileCount;
+        dirCount += aggregate->dirCount;
+        aggregates[parentEntry] = *aggregate;
+        _updateSpillBlockers(parentEntry, 1);
+    }
+
+    parentEntry->endChildrenUpdate(sizeBefore);
+
     // also delete all pointers to removed children (and their children recursively)
-    // from crc map (since all children will be deleted)
+    // from index (since all children will be deleted)
     // this function will also subtract actual deleted files and dirs from fileCount and dirCount
     // actual deleted number might be different from deletedFileCount and deletedDirCount since
     // deleted directories might have children too
-    for (auto &child : deletedChildren)
-        _cleanupEntryCrc(*child);
+    for (auto &child : deletedChildren) {
+        if (child->isDir() && deletedPaths) {
+            auto childPath = Utils::make_unique<FilePath>(path);
+            childPath->addDir(child->getName(), child->getNameCrc());
+            deletedPaths->push_back(std::move(childPath));
+        }
+        if (deletedFiles)
+            collectFiles(*child, path, *deletedFiles);
+        auto blocked = blockedDirs.find(child.get());
+        if (blocked != blockedDirs.end())
+            _updateSpillBlockers(parentEntry, -blocked->second);
+        _cleanupEntryIndex(*child);
+    }
+
+    // subtrees that contain this directory are counted again when they are spilled
+    for (const FileEntry *e = parentEntry; e && !spillCandidates.empty(); e = e->getParent()) {
+        auto it = spillCandidates.find(e);
+        if (it != spillCandidates.end())
+            it->second = -1;
+    }
 
     usedSpace = rootFile->getSize();
     bHasChanges = true;
@@ -115,48 +369,47 @@ const FilePath &FileDB::getRootPath() const {
     return *rootPath;
 }
 
-void FileDB::_cleanupEntryCrc(const FileEntry &entry) {
+void FileDB::_cleanupEntryIndex(const FileEntry &entry) {
     entry.forEach([this](const FileEntry &child) -> bool {
-        _cleanupEntryCrc(child);
+        _cleanupEntryIndex(child);
         return true;
     });
-    auto it = entriesMap.find(entry.getPathCrc());
-    if (it != entriesMap.end()) {
-        for (auto it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
-            if ((*it2) == &entry) {
-                if (entry.isDir())
-                    --dirCount;
-                else
-                    --fileCount;
-                it->second.erase(it2);
-                if (it->second.empty())
-                    entriesMap.erase(it);
-                return;
-            }
+    if (entry.isDir()) {
+        dirStamps.erase(&entry);
+        pendingDirs.erase(&entry);
+        blockedDirs.erase(&entry);
+        spillCandidates.erase(&entry);
+        if (recentlyLoaded == &entry)
+            recentlyLoaded = nullptr;
+
+        auto aggregateIt = aggregates.find(&entry);
+        if (aggregateIt != aggregates.end()) {
+            fileCount -= aggregateIt->second.fileCount;
+            dirCount -= aggregateIt->second.dirCount;
+            aggregates.erase(aggregateIt);
         }
+
+        // children of spilled directory are only in spill file, so they are counted here
+        _dropSpilledEntry(&entry);
+    }
+    if (entriesIndex.remove(&entry)) {
+        if (entry.isDir())
+            --dirCount;
+        else
+            --fileCount;
     }
 }
 
-FileEntry *FileDB::_findEntry(const char *entryName, uint16_t nameCrc, FileEntry *parent) const {
+FileEntry *FileDB::_findEntry(uint32_t nameId, FileEntry *parent) const {
     if (!parent) {
         //only root can be without parents
-        if (strcmp(entryName, rootFile->getName()) == 0)
+        if (rootFile->getNameId() == nameId)
             return rootFile.get();
         return nullptr;
     }
 
-    auto pathCrc = parent->getPathCrc() ^ nameCrc;
-    auto it = entriesMap.find(pathCrc);
-    if (it == entriesMap.end())
-        return nullptr;
-
-    auto vIt = it->second.begin();
-    while (vIt != it->second.end()) {
-        if ((*vIt)->getParent() == parent && strcmp(entryName, (*vIt)->getName()) == 0)
-            return (*vIt);
-        ++vIt;
-    }
-    return nullptr;
+    // names are interned, so they are compared only by their ids
+    return entriesIndex.find(parent, nameId);
 }
 
 FileEntry *FileDB::_findEntry(const FilePath &path) const {
@@ -165,52 +418,331 @@ FileEntry *FileDB::_findEntry(const FilePath &path) const {
     //provided path should have the same root as name of root entry
     if (parts.front() != rootFile->getName())
         return nullptr;
-    if (parts.size() == 1)
-        return rootFile.get();
 
-    auto pathCrc = path.getPathCrc();
+    // descend from root, looking up each part of path by its parent
+    FileEntry *currentEntry = rootFile.get();
+    for (size_t i = 1; i < parts.size() && currentEntry; ++i) {
+        auto &part = parts[i];
+        bool isPartDir = part.back() == PlatformUtils::filePathSeparator;
+        // part that is dir will have slash at the end so its length will be bigger by 1
+        auto partLen = isPartDir ? (part.length() - 1) : part.length();
+
+        currentEntry = entriesIndex.find(currentEntry, part.c_str(), partLen);
+    }
+    return currentEntry;
+}
 
-    auto it = entriesMap.find(pathCrc);
-    if (it == entriesMap.end())
+FileEntry *FileDB::_findSpilledEntry(const FilePath &path) const {
+    auto &parts = path.getParts();
+    if (parts.front() != rootFile->getName())
         return nullptr;
 
-    auto vIt = it->second.begin();
+    FileEntry *currentEntry = rootFile.get();
+    for (size_t i = 1; i < parts.size(); ++i) {
+        // children of spilled directory are not in index, so search can't go deeper
+        if (spilledDirs.count(currentEntry) != 0)
+            return currentEntry;
 
-    while (vIt != it->second.end()) {
-        const FileEntry *currentEntry = *vIt;
+        auto &part = parts[i];
+        bool isPartDir = part.back() == PlatformUtils::filePathSeparator;
+        auto partLen = isPartDir ? (part.length() - 1) : part.length();
 
-        // for each possible entry check its name and names of all parents that they
-        // are the same as in provided path
-        for (int i = (int) parts.size() - 1; i > 0; --i) {
-            auto &part = parts[i];
-            bool isPartDir = part.back() == PlatformUtils::filePathSeparator;
-            // part that is dir will have slash at the end so its length will be bigger by 1
-            auto partLen = isPartDir ? (part.length() - 1) : part.length();
+        currentEntry = entriesIndex.find(currentEntry, part.c_str(), partLen);
+        if (!currentEntry)
+            return nullptr;
+    }
+    return spilledDirs.count(currentEntry) != 0 ? currentEntry : nullptr;
+}
 
-            auto name = currentEntry->getName();
+void FileDB::_loadSpilledPath(const FilePath &path) const {
+    // each loaded directory reveals its children, so path is searched again from root
+    while (auto entry = _findSpilledEntry(path)) {
+        if (!_loadSpilledEntry(entry))
+            break;
+    }
+}
+
+void FileDB::loadSpilledPath(const FilePath &path) const {
+    if (spilledCount == 0)
+        return;
+    {
+        SharedLock lock_mtx(dbMtx);
+        if (!_findSpilledEntry(path))
+            return;
+    }
+    std::lock_guard<SharedMutex> lock(dbMtx);
+    _loadSpilledPath(path);
+}
 
-            if (currentEntry->getParent() != nullptr // only root is without parent and we already checked it
-                && strncmp(part.c_str(), name, partLen) == 0
-                && name[partLen] == '\0') {
-                currentEntry = currentEntry->getParent();
-            } else
-                break;
+bool FileDB::_loadSpilledEntry(FileEntry *entry) const {
+    auto it = spilledDirs.find(entry);
+    if (it == spilledDirs.end())
+        return false;
+    auto spilled = it->second;
+
+    // spilled children are stored the same way as in snapshot: nodes, names and stamps
+    // they are restored right from mapping of spill file, so block is not copied
+    bool restored = false;
+    auto isRead = spillFile->view(spilled.offset, size_t(spilled.blockSize), [&](const char *block) {
+        auto nodes = block;
+        auto names = nodes + spilled.nodeCount * sizeof(SnapshotNode);
+        auto stamps = names + spilled.namesSize;
+
+        auto readNode = [nodes](uint64_t index, SnapshotNode &node) -> bool {
+            memcpy(&node, nodes + index * sizeof(SnapshotNode), sizeof(node));
+            return true;
+        };
+        uint64_t stampIndex = 0;
+        restored = restoreChildren(entry, spilled.childCount, 0, spilled.nodeCount, readNode, names,
+                                   [&](FileEntry *child, uint64_t nodeIndex) {
+                                       entriesIndex.insert(child);
+                                       if (stampIndex == spilled.stampCount)
+                                           return;
+                                       SnapshotStamp stamp{};
+                                       memcpy(&stamp, stamps + stampIndex * sizeof(SnapshotStamp),
+                                              sizeof(stamp));
+                                       if (stamp.nodeIndex != nodeIndex)
+                                           return;
+                                       dirStamps[child] = fromSnapshotStamp(stamp);
+                                       ++stampIndex;
+                                   });
+    });
+    if (!isRead) {
+        // directory stays spilled, so its totals are still correct and it can be read later
+        std::cerr << "Can't read spilled entries\n";
+        return false;
+    }
+    spilledDirs.erase(it);
+    _updateSpillBlockers(entry, -1);
+    spilledCount -= int64_t(spilled.nodeCount);
+    spillFile->release(spilled.offset, size_t(spilled.blockSize));
+    recentlyLoaded = entry;
+
+    if (!restored)
+        std::cerr << "Spilled entries are corrupted\n";
+    bHasChanges = true;
+    return true;
+}
+
+bool FileDB::_dropSpilledEntry(const FileEntry *entry) {
+    auto it = spilledDirs.find(entry);
+    if (it == spilledDirs.end())
+        return false;
+    fileCount -= it->second.fileCount;
+    dirCount -= it->second.dirCount;
+    spilledCount -= int64_t(it->second.nodeCount);
+    spillFile->release(it->second.offset, size_t(it->second.blockSize));
+    spilledDirs.erase(it);
+    return true;
+}
+
+bool FileDB::_spillEntry(FileEntry *entry) {
+    SpilledDir spilled{};
+    std::vector<SnapshotNode> nodes;
+    std::string names;
+    std::vector<SnapshotStamp> stamps;
+
+    std::function<void(const FileEntry &)> writeNode = [&](const FileEntry &child) {
+        SnapshotNode node{};
+        node.size = child.getSize();
+        node.nameOffset = names.size();
+        node.childCount = uint32_t(child.getChildCount());
+        node.nameLength = uint16_t(strlen(child.getName()));
+        node.isDir = child.isDir() ? 1 : 0;
+        if (child.isDir()) {
+            ++spilled.dirCount;
+            auto it = dirStamps.find(&child);
+            if (it != dirStamps.end())
+                stamps.push_back(toSnapshotStamp(nodes.size(), it->second));
+        } else
+            ++spilled.fileCount;
+        nodes.push_back(node);
+        names.append(child.getName(), node.nameLength);
+        child.forEach([&writeNode](const FileEntry &c) -> bool {
+            writeNode(c);
+            return true;
+        });
+    };
+    entry->forEach([&writeNode](const FileEntry &child) -> bool {
+        writeNode(child);
+        return true;
+    });
+
+    std::string block;
+    block.reserve(nodes.size() * sizeof(SnapshotNode) + names.size() + stamps.size() * sizeof(SnapshotStamp));
+    block.append(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(SnapshotNode));
+    block.append(names);
+    block.append(reinterpret_cast<const char *>(stamps.data()), stamps.size() * sizeof(SnapshotStamp));
+    try {
+        spilled.offset = spillFile->write(block.data(), block.size());
+    } catch (std::exception &) {
+        return false;
+    }
+    spilled.blockSize = block.size();
+    spilled.nodeCount = nodes.size();
+    spilled.namesSize = names.size();
+    spilled.stampCount = stamps.size();
+    spilled.childCount = uint32_t(entry->getChildCount());
+
+    // entries are removed from index, but they are still counted as files and dirs of db
+    std::function<void(const FileEntry &)> removeEntry = [&](const FileEntry &child) {
+        child.forEach([&removeEntry](const FileEntry &c) -> bool {
+            removeEntry(c);
+            return true;
+        });
+        if (child.isDir()) {
+            dirStamps.erase(&child);
+            spillCandidates.erase(&child);
         }
-        if (currentEntry == rootFile.get())
-            return *vIt;
+        entriesIndex.remove(&child);
+    };
+    entry->forEach([&removeEntry](const FileEntry &child) -> bool {
+        removeEntry(child);
+        return true;
+    });
+    std::vector<std::unique_ptr<FileEntry>> children;
+    entry->takeChildren(children);
+    children.clear();
+
+    spilledDirs[entry] = spilled;
+    _updateSpillBlockers(entry, 1);
+    spilledCount += int64_t(spilled.nodeCount);
+    bHasChanges = true;
+    return true;
+}
+
+void FileDB::_updateSpillBlockers(const FileEntry *entry, int64_t delta) const {
+    if (memoryBudget <= 0)
+        return;
+    int depth = 0;
+    for (auto e = entry->getParent(); e; e = e->getParent())
+        ++depth;
+
+    // directory is counted in all its parents, so counts don't decrease towards root
+    // and the highest unblocked directory contains all other ones
+    const FileEntry *unblocked = nullptr;
+    for (auto e = entry; e; e = e->getParent(), --depth) {
+        auto &count = blockedDirs[e];
+        count += delta;
+        if (count > 0) {
+            spillCandidates.erase(e);
+            continue;
+        }
+        blockedDirs.erase(e);
+        if (depth >= SPILL_MIN_DEPTH)
+            unblocked = e;
+    }
+    if (unblocked)
+        spillCandidates[unblocked] = -1;
+}
+
+void FileDB::_collectSpillCandidates() {
+    for (auto &aggregate : aggregates)
+        _updateSpillBlockers(aggregate.first, 1);
+    for (auto &spilled : spilledDirs)
+        _updateSpillBlockers(spilled.first, 1);
+
+    std::function<void(const FileEntry &, int)> collect = [&](const FileEntry &entry, int depth) {
+        if (depth >= SPILL_MIN_DEPTH && blockedDirs.count(&entry) == 0) {
+            spillCandidates[&entry] = -1;
+            return;
+        }
+        entry.forEach([&](const FileEntry &child) -> bool {
+            if (child.isDir())
+                collect(child, depth + 1);
+            return true;
+        });
+    };
+    collect(*rootFile, 0);
+}
+
+void FileDB::_spillIfNeeded() {
+    auto usage = getMemoryUsage();
+    if (memoryBudget <= 0 || usage <= memoryBudget || usage < nextSpillUsage)
+        return;
+
+    // recently loaded directory is not spilled again, so are subtrees that contain it
+    std::unordered_set<const FileEntry *> loadedPath;
+    for (auto e = recentlyLoaded; e; e = e->getParent())
+        loadedPath.insert(e);
+
+    // only subtrees of candidates are counted, the rest of tree is not walked
+    std::vector<std::pair<const FileEntry *, int64_t>> candidates;
+    for (auto &candidate : spillCandidates) {
+        if (loadedPath.count(candidate.first) > 0)
+            continue;
+        // subtree will be spilled as part of a bigger one
+        bool isCovered = false;
+        for (auto p = candidate.first->getParent(); p && !isCovered; p = p->getParent())
+            isCovered = spillCandidates.count(p) > 0 && loadedPath.count(p) == 0;
+        if (isCovered)
+            continue;
+        if (candidate.second < 0)
+            candidate.second = countEntries(*candidate.first);
+        if (candidate.second >= SPILL_MIN_ENTRIES)
+            candidates.emplace_back(candidate.first, candidate.second);
+    }
+
+    // the biggest subtrees go first, so as few directories as possible lose their children
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<const FileEntry *, int64_t> &a, const std::pair<const FileEntry *, int64_t> &b) {
+                  return a.second > b.second;
+              });
 
-        ++vIt;
+    // stop well below budget, so spilling doesn't happen after each change
+    auto target = memoryBudget / 4 * 3;
+    for (auto &candidate : candidates) {
+        if (getMemoryUsage() <= target)
+            break;
+        auto entry = entriesIndex.find(candidate.first->getParent(), candidate.first->getNameId());
+        if (!entry || !_spillEntry(entry))
+            break;
     }
-    return nullptr;
+    nextSpillUsage = getMemoryUsage() + memoryBudget / 4;
+}
+
+bool FileDB::getChildDirsIfUnchanged(const FilePath &path, const PlatformUtils::DirStamp &stamp,
+                                     std::vector<std::unique_ptr<FilePath>> &childDirs) const {
+    loadSpilledPath(path);
+    SharedLock lock_mtx(dbMtx);
+    auto entry = _findEntry(path);
+    if (!entry || !entry->isDir())
+        return false;
+
+    auto it = dirStamps.find(entry);
+    if (it == dirStamps.end() || it->second != stamp)
+        return false;
+
+    entry->forEach([&path, &childDirs](const FileEntry &child) -> bool {
+        if (child.isDir()) {
+            auto childPath = Utils::make_unique<FilePath>(path);
+            childPath->addDir(child.getName(), child.getNameCrc());
+            childDirs.push_back(std::move(childPath));
+        }
+        return true;
+    });
+    return true;
 }
 
 const FileEntry *FileDB::findEntry(const FilePath &path) const {
-    std::lock_guard<std::mutex> lock_mtx(dbMtx);
+    loadSpilledPath(path);
+    SharedLock lock_mtx(dbMtx);
     return _findEntry(path);
 }
 
+bool FileDB::getAggregate(const FilePath &path, Aggregate &aggregate) const {
+    // spilled subtrees never have aggregated directories, so nothing is loaded
+    SharedLock lock_mtx(dbMtx);
+    auto it = aggregates.find(_findEntry(path));
+    if (it == aggregates.end())
+        return false;
+    aggregate = it->second;
+    return true;
+}
+
 bool FileDB::processEntry(const FilePath &path, const std::function<void(const FileEntry &)> &func) const {
-    std::lock_guard<std::mutex> lock_mtx(dbMtx);
+    loadSpilledPath(path);
+    SharedLock lock_mtx(dbMtx);
     auto e = _findEntry(path);
     if (!e)
         return false;
@@ -241,3 +773,274 @@ int64_t FileDB::getFileCount() const {
 int64_t FileDB::getDirCount() const {
     return dirCount;
 }
+
+SizeMode FileDB::getSizeMode() const {
+    return sizeMode;
+}
+
+bool FileDB::setMemoryBudget(int64_t bytes, const std::string &spillPath) {
+    std::lock_guard<SharedMutex> lock(dbMtx);
+    if (bytes > 0 && !spillFile) {
+        try {
+            spillFile = Utils::make_unique<SpillFile>(spillPath);
+        } catch (std::exception &) {
+            return false;
+        }
+    }
+    bool wasLimited = memoryBudget > 0;
+    memoryBudget = bytes > 0 ? bytes : 0;
+    nextSpillUsage = 0;
+    if (memoryBudget == 0) {
+        pendingDirs.clear();
+        blockedDirs.clear();
+        spillCandidates.clear();
+    } else if (!wasLimited)
+        _collectSpillCandidates();
+    return true;
+}
+
+int64_t FileDB::getMemoryUsage() const {
+    return (fileCount + dirCount - spilledCount) * ENTRY_MEMORY_SIZE;
+}
+
+int64_t FileDB::getSpilledCount() const {
+    return spilledCount;
+}
+
+bool FileDB::saveSnapshot(const std::string &snapshotPath) const {
+    auto tmpPath = snapshotPath + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.nodeSize = sizeof(SnapshotNode);
+    header.totalSpace = totalSpace;
+    header.availableSpace = availableSpace;
+    header.sizeMode = static_cast<uint32_t>(sizeMode);
+    // header is rewritten when all counts are known
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    bool isSpillRead = true;
+    {
+        SharedLock lock_mtx(dbMtx);
+
+        // nodes and names are written in the same order, so name offsets are known without buffering
+        std::vector<SnapshotStamp> stamps;
+        std::vector<SnapshotAggregate> dirAggregates;
+        std::function<void(const FileEntry &)> writeNode = [&](const FileEntry &entry) {
+            if (entry.isDir()) {
+                auto it = dirStamps.find(&entry);
+                if (it != dirStamps.end())
+                    stamps.push_back(toSnapshotStamp(header.nodeCount, it->second));
+                auto aggregateIt = aggregates.find(&entry);
+                if (aggregateIt != aggregates.end())
+                    dirAggregates.push_back({header.nodeCount, aggregateIt->second.size,
+                                             aggregateIt->second.fileCount, aggregateIt->second.dirCount});
+            }
+            auto spilled = spilledDirs.find(&entry);
+            bool isSpilled = spilled != spilledDirs.end();
+            SnapshotNode node{};
+            node.size = entry.getSize();
+            node.nameOffset = header.namesSize;
+            node.childCount = isSpilled ? spilled->second.childCount : uint32_t(entry.getChildCount());
+            node.nameLength = uint16_t(strlen(entry.getName()));
+            node.isDir = entry.isDir() ? 1 : 0;
+            file.write(reinterpret_cast<const char *>(&node), sizeof(node));
+            ++header.nodeCount;
+            header.namesSize += node.nameLength;
+            if (isSpilled) {
+                // spilled children are already flattened, only their offsets are moved
+                auto &dir = spilled->second;
+                std::vector<SnapshotNode> nodes(size_t(dir.nodeCount));
+                std::vector<SnapshotStamp> spilledStamps(size_t(dir.stampCount));
+                isSpillRead = spillFile->read(dir.offset, nodes.data(), nodes.size() * sizeof(SnapshotNode)) &&
+                              spillFile->read(dir.offset + nodes.size() * sizeof(SnapshotNode) + dir.namesSize,
+                                              spilledStamps.data(),
+                                              spilledStamps.size() * sizeof(SnapshotStamp)) && isSpillRead;
+                for (auto &n : nodes)
+                    n.nameOffset += header.namesSize;
+                for (auto &st : spilledStamps) {
+                    st.nodeIndex += header.nodeCount;
+                    stamps.push_back(st);
+                }
+                file.write(reinterpret_cast<const char *>(nodes.data()),
+                           std::streamsize(nodes.size() * sizeof(SnapshotNode)));
+                header.nodeCount += dir.nodeCount;
+                header.namesSize += dir.namesSize;
+            }
+            entry.forEach([&writeNode](const FileEntry &child) -> bool {
+                writeNode(child);
+                return true;
+            });
+        };
+        std::function<void(const FileEntry &)> writeName = [&](const FileEntry &entry) {
+            file.write(entry.getName(), std::streamsize(strlen(entry.getName())));
+            auto spilled = spilledDirs.find(&entry);
+            if (spilled != spilledDirs.end()) {
+                auto &dir = spilled->second;
+                std::vector<char> names(size_t(dir.namesSize));
+                isSpillRead = spillFile->read(dir.offset + dir.nodeCount * sizeof(SnapshotNode),
+                                              names.data(), names.size()) && isSpillRead;
+                file.write(names.data(), std::streamsize(names.size()));
+            }
+            entry.forEach([&writeName](const FileEntry &child) -> bool {
+                writeName(child);
+                return true;
+            });
+        };
+        writeNode(*rootFile);
+        writeName(*rootFile);
+        file.write(reinterpret_cast<const char *>(stamps.data()),
+                   std::streamsize(stamps.size() * sizeof(SnapshotStamp)));
+        header.stampCount = stamps.size();
+        file.write(reinterpret_cast<const char *>(dirAggregates.data()),
+                   std::streamsize(dirAggregates.size() * sizeof(SnapshotAggregate)));
+        header.aggregateCount = dirAggregates.size();
+    }
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+    if (!file || !isSpillRead) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    // rename doesn't replace existing files on windows
+    std::remove(snapshotPath.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), snapshotPath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<FileDB> FileDB::loadSnapshot(const std::string &snapshotPath) {
+    std::unique_ptr<MappedFile> mapped;
+    try {
+        mapped = Utils::make_unique<MappedFile>(snapshotPath);
+    } catch (std::exception &) {
+        return nullptr;
+    }
+
+    auto data = mapped->data();
+    SnapshotHeader header{};
+    if (mapped->size() < sizeof(header))
+        return nullptr;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.nodeSize != sizeof(SnapshotNode) ||
+        header.nodeCount == 0 || header.sizeMode > static_cast<uint32_t>(SizeMode::ON_DISK))
+        return nullptr;
+
+    auto available = uint64_t(mapped->size() - sizeof(header));
+    if (header.nodeCount > available / sizeof(SnapshotNode))
+        return nullptr;
+    available -= header.nodeCount * sizeof(SnapshotNode);
+    if (header.stampCount > available / sizeof(SnapshotStamp))
+        return nullptr;
+    available -= header.stampCount * sizeof(SnapshotStamp);
+    if (header.aggregateCount > available / sizeof(SnapshotAggregate) ||
+        header.namesSize != available - header.aggregateCount * sizeof(SnapshotAggregate))
+        return nullptr;
+
+    auto nodes = data + sizeof(header);
+    auto names = reinterpret_cast<const char *>(nodes + header.nodeCount * sizeof(SnapshotNode));
+    auto stamps = nodes + header.nodeCount * sizeof(SnapshotNode) + header.namesSize;
+    auto dirAggregates = stamps + header.stampCount * sizeof(SnapshotStamp);
+
+    auto readNode = [&header, nodes](uint64_t index, SnapshotNode &node) -> bool {
+        memcpy(&node, nodes + index * sizeof(SnapshotNode), sizeof(node));
+        return node.nameLength > 0 && node.nameOffset <= header.namesSize &&
+               node.nameLength <= header.namesSize - node.nameOffset &&
+               (node.isDir || node.childCount == 0);
+    };
+
+    SnapshotNode node{};
+    if (!readNode(0, node) || !node.isDir)
+        return nullptr;
+
+    std::unique_ptr<FileDB> db;
+    try {
+        db = Utils::make_unique<FileDB>(std::string(names + node.nameOffset, node.nameLength),
+                                        static_cast<SizeMode>(header.sizeMode));
+    } catch (std::exception &) {
+        return nullptr;
+    }
+    // root entry stores normalized path, so snapshot root should match it
+    if (strncmp(db->rootFile->getName(), names + node.nameOffset, node.nameLength) != 0 ||
+        db->rootFile->getName()[node.nameLength] != '\0')
+        return nullptr;
+
+    db->totalSpace = header.totalSpace;
+    db->availableSpace = header.availableSpace;
+    db->rootFile->setSize(node.size);
+    db->entriesIndex.reserve(size_t(header.nodeCount - 1));
+    db->dirStamps.reserve(size_t(header.stampCount));
+
+    // stamps are sorted by node index, so they are assigned while nodes are restored
+    uint64_t stampIndex = 0;
+    SnapshotStamp stamp{};
+    auto nextStamp = [&]() {
+        if (stampIndex < header.stampCount)
+            memcpy(&stamp, stamps + (stampIndex++) * sizeof(SnapshotStamp), sizeof(stamp));
+        else
+            stamp.nodeIndex = header.nodeCount;
+    };
+    auto restoreStamp = [&](uint64_t nodeIndex, FileEntry *entry) {
+        if (stamp.nodeIndex != nodeIndex)
+            return;
+        db->dirStamps[entry] = fromSnapshotStamp(stamp);
+        nextStamp();
+    };
+
+    // aggregates are sorted the same way
+    int64_t files = 0;
+    int64_t dirs = 1;
+    uint64_t aggregateIndex = 0;
+    SnapshotAggregate aggregate{};
+    auto nextAggregate = [&]() {
+        if (aggregateIndex < header.aggregateCount)
+            memcpy(&aggregate, dirAggregates + (aggregateIndex++) * sizeof(SnapshotAggregate), sizeof(aggregate));
+        else
+            aggregate.nodeIndex = header.nodeCount;
+    };
+    auto restoreAggregate = [&](uint64_t nodeIndex, FileEntry *entry) {
+        if (aggregate.nodeIndex != nodeIndex)
+            return;
+        db->aggregates[entry] = Aggregate{aggregate.size, aggregate.fileCount, aggregate.dirCount};
+        files += aggregate.fileCount;
+        dirs += aggregate.dirCount;
+        nextAggregate();
+    };
+
+    nextStamp();
+    restoreStamp(0, db->rootFile.get());
+    nextAggregate();
+    restoreAggregate(0, db->rootFile.get());
+
+    auto restored = restoreChildren(db->rootFile.get(), node.childCount, 1, header.nodeCount, readNode, names,
+                                    [&](FileEntry *entry, uint64_t nodeIndex) {
+                                        db->entriesIndex.insert(entry);
+                                        if (entry->isDir()) {
+                                            ++dirs;
+                                            restoreStamp(nodeIndex, entry);
+                                            restoreAggregate(nodeIndex, entry);
+                                        } else
+                                            ++files;
+                                    });
+    if (!restored)
+        return nullptr;
+
+    db->fileCount = files;
+    db->dirCount = dirs;
+    db->usedSpace = db->rootFile->getSize();
+    db->bHasChanges = true;
+
+    return db;
+}
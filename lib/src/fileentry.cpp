@@ -1,26 +1,89 @@
-
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <new>
 
 #include "fileentry.h"
+#include "EntryTable.h"
+#include "NamePool.h"
 #include "utils.h"
 
 extern "C" {
 #include <crc.h>
 }
 
+// set in references to slots that only point to entries which are not stored in table
+static const uint32_t FOREIGN_REF_BIT = EntryTable::maxRef;
+
+// capacity of children array when first child is added
+static const uint32_t MIN_CHILDREN_CAPACITY = 2;
+
+static EntryTable &getEntryTable() {
+    // never destroyed, since entries might be deleted during destruction of other static objects
+    static EntryTable *table = new EntryTable(sizeof(FileEntry));
+    return *table;
+}
+
 FileEntry::FileEntry(const std::string &name_, bool isDir_, int64_t size_) :
-        bIsDir(isDir_), pendingDelete(false), parent(nullptr),
-        nameCrc(0), pathCrc(0), size(size_) {
+        FileEntry(EntryTable::nullRef, name_, isDir_, size_) {}
+
+FileEntry::FileEntry(uint32_t ref, const std::string &name_, bool isDir_, int64_t size_) :
+        parentRef(EntryTable::nullRef), selfRef(ref), children(nullptr), childCount(0), childCapacity(0),
+        size(size_), nameId(NamePool::invalidId), nameCrc(0), pendingDelete(false), bIsDir(isDir_),
+        childrenUpdating(false), childrenUnsorted(false) {
     auto nameLen = name_.length();
     if (nameLen == 0)
         throw std::invalid_argument("Can't create FileEntry with empty name");
 
-    auto chars = Utils::make_unique_arr<char>(nameLen + 1);
-    memcpy(chars.get(), name_.c_str(), (nameLen + 1) * sizeof(char));
-    nameCrc = crc16(chars.get(), (uint16_t) nameLen);
-    pathCrc = nameCrc;
-    name = std::move(chars);
+    nameId = NamePool::acquire(name_.c_str(), nameLen);
+    nameCrc = crc16(name_.c_str(), (uint16_t) nameLen);
+
+    if (selfRef == EntryTable::nullRef) {
+        // entry is not in table, so its reference points to slot that stores pointer to it
+        auto slot = getEntryTable().allocate(selfRef);
+        *static_cast<FileEntry **>(slot) = this;
+        selfRef |= FOREIGN_REF_BIT;
+    }
+}
+
+std::unique_ptr<FileEntry> FileEntry::create(const std::string &name, bool isDir, int64_t size) {
+    auto &table = getEntryTable();
+    uint32_t ref;
+    auto ptr = table.allocate(ref);
+    try {
+        // global placement new, since class doesn't allow its own allocation
+        return std::unique_ptr<FileEntry>(::new(ptr) FileEntry(ref, name, isDir, size));
+    } catch (...) {
+        table.deallocate(ptr);
+        throw;
+    }
+}
+
+FileEntry::~FileEntry() {
+    for (uint32_t i = 0; i < childCount; ++i)
+        delete getChild(i);
+    SlabPool::deallocate(children, childCapacity * sizeof(uint32_t));
+
+    NamePool::release(nameId);
+    if (selfRef & FOREIGN_REF_BIT) {
+        auto &table = getEntryTable();
+        table.deallocate(table.get(selfRef & ~FOREIGN_REF_BIT));
+    }
+}
+
+void FileEntry::operator delete(void *ptr) {
+    getEntryTable().deallocate(ptr);
+}
+
+FileEntry *FileEntry::getEntry(uint32_t ref) {
+    auto &table = getEntryTable();
+    if (ref & FOREIGN_REF_BIT)
+        return *static_cast<FileEntry **>(table.get(ref & ~FOREIGN_REF_BIT));
+    return static_cast<FileEntry *>(table.get(ref));
+}
+
+FileEntry *FileEntry::getChild(size_t index) const {
+    return getEntry(children[index]);
 }
 
 void FileEntry::addChild(std::unique_ptr<FileEntry> child) {
@@ -32,79 +95,123 @@ void FileEntry::addChild(std::unique_ptr<FileEntry> child) {
     _addChild(std::move(child));
     size += childSize;
 
-    if (parent)
-        parent->onChildSizeChanged(this, childSize);
+    if (parentRef != EntryTable::nullRef && !childrenUpdating)
+        getEntry(parentRef)->onChildSizeChanged(this, childSize);
+}
+
+void FileEntry::restoreChild(std::unique_ptr<FileEntry> child) {
+    _addChild(std::move(child));
+}
+
+void FileEntry::takeChildren(std::vector<std::unique_ptr<FileEntry>> &removedChildren) {
+    for (uint32_t i = 0; i < childCount; ++i)
+        removedChildren.push_back(std::unique_ptr<FileEntry>(getChild(i)));
+    SlabPool::deallocate(children, childCapacity * sizeof(uint32_t));
+    children = nullptr;
+    childCount = 0;
+    childCapacity = 0;
+}
+
+size_t FileEntry::getChildCount() const {
+    return childCount;
 }
 
 void FileEntry::removePendingDelete(std::vector<std::unique_ptr<FileEntry>> &deletedChildren) {
     int64_t changedSize = 0;
-    auto it = children.begin();
-    while (it != children.end()) {
-        if (!it->firstEntry) //this shouldn't happen, but better check
-            it = children.erase(it);
-
-        auto child = it->firstEntry.get();
-        while (child->nextEntry) {
-            if (child->nextEntry->pendingDelete) {
-                auto temp = std::move(child->nextEntry);
-                child->nextEntry = std::move(temp->nextEntry);
-                changedSize += temp->size;
-                deletedChildren.push_back(std::move(temp));
-                continue;
-            }
-            child = child->nextEntry.get();
-        }
-        //now all children in this bin (except first) are processed
-        //now check if first child should also be removed and if it is, check if we have anything left
-        if (it->firstEntry->pendingDelete) {
-            auto &ptrFirst = const_cast<std::unique_ptr<FileEntry> &>(it->firstEntry);
-            auto temp = std::move(ptrFirst);
-            if (temp->nextEntry)
-                ptrFirst = std::move(temp->nextEntry);
-            changedSize += temp->size;
-            deletedChildren.push_back(std::move(temp));
+    // compact children in place, so their order is preserved
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < childCount; ++i) {
+        auto child = getChild(i);
+        if (child->pendingDelete) {
+            changedSize += child->size;
+            deletedChildren.push_back(std::unique_ptr<FileEntry>(child));
+        } else {
+            children[kept] = children[i];
+            ++kept;
         }
-        //if no entries left, delete bin
-        if (!it->firstEntry)
-            it = children.erase(it);
-        else
-            ++it;
     }
+    childCount = kept;
+
     if (changedSize > 0) {
         size -= changedSize;
-        if (parent)
-            parent->onChildSizeChanged(this, -changedSize);
+        if (parentRef != EntryTable::nullRef && !childrenUpdating)
+            getEntry(parentRef)->onChildSizeChanged(this, -changedSize);
+    }
+}
+
+int64_t FileEntry::beginChildrenUpdate() {
+    childrenUpdating = true;
+    return size;
+}
+
+void FileEntry::endChildrenUpdate(int64_t sizeBefore) {
+    childrenUpdating = false;
+    if (childrenUnsorted) {
+        // stable sort keeps order of children with the same size
+        std::stable_sort(children, children + childCount, [](uint32_t a, uint32_t b) {
+            return getEntry(a)->size > getEntry(b)->size;
+        });
+        childrenUnsorted = false;
     }
+
+    // parents are updated once for the whole batch
+    if (parentRef != EntryTable::nullRef && size != sizeBefore)
+        getEntry(parentRef)->onChildSizeChanged(this, size - sizeBefore);
+}
+
+void FileEntry::reserveChildren(uint32_t count) {
+    if (count <= childCapacity)
+        return;
+
+    auto newCapacity = std::max(childCapacity * 2, std::max(count, MIN_CHILDREN_CAPACITY));
+    auto newChildren = static_cast<uint32_t *>(SlabPool::allocate(newCapacity * sizeof(uint32_t)));
+    if (childCount > 0)
+        memcpy(newChildren, children, childCount * sizeof(uint32_t));
+    SlabPool::deallocate(children, childCapacity * sizeof(uint32_t));
+    children = newChildren;
+    childCapacity = newCapacity;
 }
 
 void FileEntry::_addChild(std::unique_ptr<FileEntry> child) {
     if (!child)
         return;
 
+    reserveChildren(childCount + 1);
+
     const auto childSize = child->size;
-    child->parent = this;
-    child->updatePathCrc(pathCrc);
-    // first try to find existing bin for appropriate size
-    auto it = children.find(EntryBin(childSize));
-    if (it != children.end()) {
-        // if it exists, just add child to the front
-        // cost cast is required because iterator returns const qualified bin
-        // pointers don't affect sorting of children so this is safe
-        auto &ptrFirst = const_cast<std::unique_ptr<FileEntry> &>(it->firstEntry);
-        child->nextEntry = std::move(ptrFirst);
-        ptrFirst = std::move(child);
-    } else {
-        // there is no bin with such size, so create new one
-        children.insert(EntryBin(childSize, std::move(child)));
+    const auto childRef = child->selfRef;
+    child->parentRef = selfRef;
+    // child is owned by this entry from now on
+    child.release();
+
+    // during scan children are usually added from biggest to smallest
+    // so in most cases child just goes to the end
+    if (childCount == 0 || getChild(childCount - 1)->size >= childSize) {
+        children[childCount++] = childRef;
+        return;
     }
+    if (childrenUpdating) {
+        // children are sorted once when update is finished
+        children[childCount++] = childRef;
+        childrenUnsorted = true;
+        return;
+    }
+    // insert after all children with the same or bigger size
+    auto it = std::upper_bound(children, children + childCount, childSize,
+                               [](int64_t sz, uint32_t ref) {
+                                   return sz > getEntry(ref)->size;
+                               });
+    memmove(it + 1, it, (children + childCount - it) * sizeof(uint32_t));
+    *it = childRef;
+    ++childCount;
 }
 
 void FileEntry::setSize(int64_t newSize) {
     auto sizeChange = newSize - size;
     size = newSize;
     // if size changed, tell about it to parent
-    if (parent && sizeChange != 0)
-        parent->onChildSizeChanged(this, sizeChange);
+    if (parentRef != EntryTable::nullRef && sizeChange != 0 && !childrenUpdating)
+        getEntry(parentRef)->onChildSizeChanged(this, sizeChange);
 }
 
 int64_t FileEntry::getSize() const {
@@ -115,35 +222,26 @@ uint16_t FileEntry::getNameCrc() const {
     return nameCrc;
 }
 
-uint16_t FileEntry::getPathCrc() const {
-    return pathCrc;
+const char *FileEntry::getName() const {
+    return NamePool::getName(nameId);
 }
 
-void FileEntry::updatePathCrc(uint16_t parentPathCrc) {
-    pathCrc = parentPathCrc ^ nameCrc;
-}
-
-const char *FileEntry::getName() const {
-    return name.get();
+uint32_t FileEntry::getNameId() const {
+    return nameId;
 }
 
 const FileEntry *FileEntry::getParent() const {
-    return parent;
+    if (parentRef == EntryTable::nullRef)
+        return nullptr;
+    return getEntry(parentRef);
 }
 
 bool FileEntry::forEach(const std::function<bool(const FileEntry &)> &func) const {
-    if (children.empty())
+    if (childCount == 0)
         return false;
 
-    for (auto &bin : children) {
-        bool stop = false;
-        auto child = bin.firstEntry.get();
-        while (child != nullptr && !stop) {
-            stop = !func(*child);
-            child = child->nextEntry.get();
-        }
-
-        if (stop)
+    for (uint32_t i = 0; i < childCount; ++i) {
+        if (!func(*getChild(i)))
             break;
     }
 
@@ -154,16 +252,13 @@ void FileEntry::markChildrenPendingDelete(int &files, int &dirs) {
     files = 0;
     dirs = 0;
 
-    for (auto &bin : children) {
-        auto child = bin.firstEntry.get();
-        while (child) {
-            if (child->bIsDir)
-                ++dirs;
-            else
-                ++files;
-            child->pendingDelete = true;
-            child = child->nextEntry.get();
-        }
+    for (uint32_t i = 0; i < childCount; ++i) {
+        auto child = getChild(i);
+        if (child->bIsDir)
+            ++dirs;
+        else
+            ++files;
+        child->pendingDelete = true;
     }
 }
 
@@ -176,7 +271,25 @@ bool FileEntry::isDir() const {
 }
 
 bool FileEntry::isRoot() const {
-    return parent == nullptr;
+    return parentRef == EntryTable::nullRef;
+}
+
+size_t FileEntry::findChild(const FileEntry *child, int64_t childSize) const {
+    // find first child with the same size and then look through all children with this size
+    // child itself might already have different size, so its ordering size is used instead
+    auto childRef = child->selfRef;
+    auto sizeOf = [childRef, childSize](uint32_t ref) -> int64_t {
+        return ref == childRef ? childSize : getEntry(ref)->size;
+    };
+    auto it = std::lower_bound(children, children + childCount, childSize,
+                               [&sizeOf](uint32_t ref, int64_t sz) {
+                                   return sizeOf(ref) > sz;
+                               });
+    for (; it != children + childCount && sizeOf(*it) == childSize; ++it) {
+        if (*it == childRef)
+            return size_t(it - children);
+    }
+    return childCount;
 }
 
 void FileEntry::onChildSizeChanged(FileEntry *child, int64_t sizeChange) {
@@ -184,49 +297,44 @@ void FileEntry::onChildSizeChanged(FileEntry *child, int64_t sizeChange) {
     if (!child || sizeChange == 0)
         return;
 
+    if (childrenUpdating) {
+        // position of child will be fixed when update is finished
+        size += sizeChange;
+        childrenUnsorted = true;
+        return;
+    }
+
     //size of child changed so we should use its previous size
-    auto it = children.find(EntryBin(child->size - sizeChange));
+    auto pos = findChild(child, child->size - sizeChange);
 
-    if (it == children.end()) {
+    if (pos == childCount) {
         //should not happen
         std::cerr << "Can't find child in parents children!\n";
         return;
     }
 
-    auto first = it->firstEntry.get();
-
-    std::unique_ptr<FileEntry> childPtr;
-
-    if (first == child) {
-        auto &ptrFirst = const_cast<std::unique_ptr<FileEntry> &>(it->firstEntry);
-        childPtr = std::move(ptrFirst);
-        if (childPtr->nextEntry)
-            ptrFirst = std::move(childPtr->nextEntry);
-        else {
-            //this was the only child in bin so we should delete bin
-            children.erase(it);
-        }
+    // move child to its new place, all children in between are shifted by one
+    auto childSize = child->size;
+    auto it = children + pos;
+    auto end = children + childCount;
+    if (sizeChange > 0) {
+        // child became bigger, so it goes before all children that are smaller
+        auto newIt = std::upper_bound(children, it, childSize,
+                                      [](int64_t sz, uint32_t ref) {
+                                          return sz > getEntry(ref)->size;
+                                      });
+        std::rotate(newIt, it, it + 1);
     } else {
-        //find child in entry chain
-        while (first != nullptr && first->nextEntry.get() != child)
-            first = first->nextEntry.get();
-
-        if (first != nullptr) {
-            childPtr = std::move(first->nextEntry);
-            first->nextEntry = std::move(childPtr->nextEntry);
-        }
-    }
-
-    if (!childPtr) {
-        //should not happen
-        std::cerr << "Can't find child in parents children!\n";
-        return;
+        // child became smaller, so it goes after all children that are bigger or the same
+        auto newIt = std::upper_bound(it + 1, end, childSize,
+                                      [](int64_t sz, uint32_t ref) {
+                                          return sz > getEntry(ref)->size;
+                                      });
+        std::rotate(it, it + 1, newIt);
     }
 
-    // now just add child back
-    _addChild(std::move(childPtr));
     size += sizeChange;
 
-    if (parent)
-        parent->onChildSizeChanged(this, sizeChange);
+    if (parentRef != EntryTable::nullRef)
+        getEntry(parentRef)->onChildSizeChanged(this, sizeChange);
 }
@@ -1,6 +1,7 @@
 
 #include "spacescanner.h"
 #include "FileIterator.h"
+#include "FileEntryIndex.h"
 #include "fileentry.h"
 #include "filepath.h"
 #include "filedb.h"
@@ -11,10 +12,23 @@
 
 #include <iostream>
 #include <chrono>
+#include <algorithm>
 
-SpaceScanner::SpaceScanner(const std::string &path) :
-        scannerStatus(ScannerStatus::IDLE), runWorker(true), isMountScanned(false),
-        watcherLimitExceeded(false) {
+// worker waits for db when it has this many uncommitted directories
+static const size_t MAX_PENDING_UPDATES = 256;
+
+// directory stamps that are newer than this are not trusted by quick rescan
+static const int64_t STABLE_STAMP_AGE_NS = 2000000000;
+
+// changes in the same directory that happen during this time are merged into one rescan
+// it is not longer than delay of previous polling watcher, so changes are shown as fast as before
+static const std::chrono::milliseconds DEFAULT_WATCHER_DEBOUNCE(20);
+
+SpaceScanner::SpaceScanner(const std::string &path, unsigned threadCount, const std::string &snapshotPath,
+                           SizeMode sizeMode) :
+        runWorker(true), idleWorkers(0), pendingTasks(0), scannedRecursively(false), isMountScanned(false),
+        loadedFromSnapshot(false), scanQueueSize(0), hasRootMountId(false), rootMountId(0), oneFileSystem(true),
+        rootPartCount(0), maxDepth(0), scannerStatus(ScannerStatus::IDLE), watcherLimitExceeded(false) {
 
     auto cantScanMsg = Utils::strFormat("Can't open %s", path.c_str());
     if (!PlatformUtils::can_scan_dir(path)) {
@@ -26,34 +40,80 @@ SpaceScanner::SpaceScanner(const std::string &path) :
     excludedMounts = PlatformUtils::getExcludedPaths();
 
     try {
-        db = Utils::make_unique<FileDB>(path);
+        db = Utils::make_unique<FileDB>(path, sizeMode);
     } catch (std::exception &) {
         std::cout << "Can't set as root: " << path << "\n";
         throw std::runtime_error(cantScanMsg);
     }
 
+    if (!snapshotPath.empty()) {
+        // snapshot is used only if it was made for the same root
+        // it is then rescanned as usual, so any changes will be applied to loaded entries
+        auto loadedDb = FileDB::loadSnapshot(snapshotPath);
+        if (loadedDb && loadedDb->getRootPath().getPath() == db->getRootPath().getPath() &&
+            loadedDb->getSizeMode() == sizeMode) {
+            db = std::move(loadedDb);
+            loadedFromSnapshot = true;
+        }
+    }
+
     watcherLimitExceeded = false;
     try {
-        watcher = SpaceWatcher::create(path);
+        // scanner needs only parent directories of changes, so it doesn't matter
+        // if events inside of deleted directories are lost
+        watcher = SpaceWatcher::create(path, true);
     } catch (std::runtime_error &) { }
+    if (watcher) {
+        // only parent path of events is used, so all events for the same directory can be merged
+        watcher->setCoalescing(true, DEFAULT_WATCHER_DEBOUNCE);
+        // idle workers sleep until something happens, so they should know about new events
+        watcher->setEventListener([this]() {
+            std::lock_guard<std::mutex> lock(scanMtx);
+            scanCv.notify_all();
+        });
+    }
 
     scannerStatus = ScannerStatus::SCANNING;
 
     isMountScanned = Utils::in_array(path, availableRoots);
+    rootPartCount = db->getRootPath().getParts().size();
+
+    PlatformUtils::DirStamp rootStamp{};
+    hasRootMountId = PlatformUtils::getDirStamp(path, rootStamp);
+    rootMountId = rootStamp.mountId;
 
     //this will load known info about disk space (available and total) to database
     updateDiskSpace();
 
-    addToQueue(Utils::make_unique<FilePath>(db->getRootPath()), true);
+    // loaded snapshot is verified with quick scan so only changed directories are listed
+    addToQueue(Utils::make_unique<FilePath>(db->getRootPath()), true, true, loadedFromSnapshot);
 
-    //Start thread after everything is initialized
-    workerThread = std::thread(&SpaceScanner::worker_run, this);
+    if (threadCount == 0)
+        threadCount = getDefaultThreadCount();
+    for (unsigned i = 0; i < threadCount; ++i)
+        workers.push_back(Utils::make_unique<ScanWorker>());
+
+    //Start threads after everything is initialized
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i]->thread = std::thread(&SpaceScanner::worker_run, this, i);
 }
 
 SpaceScanner::~SpaceScanner() {
-    runWorker = false;
-    scannerStatus = ScannerStatus::STOPPING;
-    workerThread.join();
+    if (watcher)
+        watcher->setEventListener(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(scanMtx);
+        runWorker = false;
+        scannerStatus = ScannerStatus::STOPPING;
+    }
+    scanCv.notify_all();
+    for (auto &worker : workers)
+        worker->thread.join();
+}
+
+unsigned SpaceScanner::getDefaultThreadCount() {
+    auto count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
 }
 
 void SpaceScanner::checkForEvents() {
@@ -65,6 +125,16 @@ void SpaceScanner::checkForEvents() {
         if (event->parentpath.empty())
             continue;
 
+        if (event->action == SpaceWatcher::FileAction::EVENTS_LOST) {
+            // lost events might be changes of file sizes, they don't change stamps of directories,
+            // so quick rescan won't find them and the whole tree is listed again
+            if (logger)
+                logger->log("Some changes were not reported by watcher, rescanning whole tree", "WATCH");
+            addToQueue(Utils::make_unique<FilePath>(db->getRootPath()), true, true, false);
+            scannerStatus = ScannerStatus::SCANNING;
+            continue;
+        }
+
         //try constructing FilePath and add it to queue
         try {
             auto path = Utils::make_unique<FilePath>(event->parentpath,
@@ -77,121 +147,323 @@ void SpaceScanner::checkForEvents() {
     }
 }
 
-void SpaceScanner::worker_run() {
+void SpaceScanner::worker_run(size_t workerIndex) {
     std::cout << "Start worker thread\n";
+    auto &worker = *workers[workerIndex];
+    ScanRequest request;
+
     while (runWorker) {
-        std::unique_lock<std::mutex> scanLock(scanMtx, std::defer_lock);
-        scanLock.lock();
-
-        using namespace std::chrono;
-        while (scanQueue.empty() && scannerStatus == ScannerStatus::IDLE) {
-            scanLock.unlock();
-            std::this_thread::sleep_for(milliseconds(20));
-            scanLock.lock();
-            checkForEvents();
+        if (scannerStatus == ScannerStatus::SCAN_PAUSED) {
+            //if scan is paused, just wait until it isn't
+            commitUpdates(worker, true);
+            std::unique_lock<std::mutex> lock(scanMtx);
+            scanCv.wait(lock, [this]() {
+                return !runWorker || scannerStatus != ScannerStatus::SCAN_PAUSED;
+            });
+            continue;
+        }
+
+        if (scannerStatus == ScannerStatus::STOPPING) {
+            std::lock_guard<std::mutex> lock(scanMtx);
+            clearRequests();
+            finishScanIfDone();
+        }
+
+        if (takeRequest(workerIndex, request)) {
+            processRequest(worker, request);
+            continue;
+        }
+
+        // nothing else to scan, so wait until everything scanned is in db
+        if (commitUpdates(worker, true))
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(worker.mtx);
+            worker.currentPath = nullptr;
         }
 
-        //scan queue is not empty at this point
-        auto start = high_resolution_clock::now();
-        // temporary queue for entries so we only lock mutex to add reasonable number of entries
-        // instead of locking for each entry
-        std::vector<std::unique_ptr<FileEntry>> scannedEntries;
-        std::vector<std::unique_ptr<FilePath>> newPaths;
-
-        updateDiskSpace();
-        bool scannedRecursively = false;
-        while (!scanQueue.empty() && scannerStatus != ScannerStatus::IDLE) {
-            auto scanRequest = std::move(scanQueue.front());
-            scanQueue.pop_front();
-            // update current scanned path with new data
-            if (currentScannedPath)
-                *currentScannedPath = *scanRequest.path;
+        std::unique_lock<std::mutex> lock(scanMtx);
+        finishScanIfDone();
+        if (scannerStatus != ScannerStatus::STOPPING)
+            checkForEvents();
+        // worker sleeps until new requests are added (by anyone) or state of scanner changes
+        // it is counted as idle before checking for requests, so it can't miss notification
+        ++idleWorkers;
+        if (!hasRequests()) {
+            // events that are still in debounce window should be taken when they are ready
+            std::chrono::steady_clock::time_point eventTime;
+            if (watcher && scannerStatus != ScannerStatus::STOPPING && watcher->getNextEventTime(eventTime))
+                scanCv.wait_until(lock, eventTime);
             else
-                currentScannedPath = Utils::make_unique<FilePath>(*scanRequest.path);
-            scanLock.unlock();
-            if (scanRequest.recursive)
-                scannedRecursively = true;
+                scanCv.wait(lock);
+        }
+        --idleWorkers;
+    }
 
-            if (watcher) {
-                if (watcher->addDir(scanRequest.path->getPath()) == SpaceWatcher::AddDirStatus::DIR_LIMIT_REACHED) {
-                    //dir was not added, should report this
-                    watcherLimitExceeded = true;
-                }
-            }
+    std::cout << "End worker thread\n";
+}
+
+bool SpaceScanner::takeRequest(size_t workerIndex, ScanRequest &request) {
+    if (scannerStatus == ScannerStatus::STOPPING)
+        return false;
 
-            // if we should perform recursive scan, store all paths to dirs in vector
-            scanChildrenAt(*scanRequest.path, scannedEntries,
-                           scanRequest.recursive ? &newPaths : nullptr);
-            // after scan, all new paths, that should be scanned, are already added to queue
-            // so we should add all new entries to database, otherwise we might not be able
-            // to find them on the next iteration
-
-            if (scannerStatus == ScannerStatus::STOPPING) {
-                //lock mutex because next action will be clearing of queue and it should be protected
-                scanLock.lock();
-                break;
+    if (scanQueueSize > 0) {
+        std::lock_guard<std::mutex> lock(scanMtx);
+        if (!scanQueue.empty() && scannerStatus != ScannerStatus::STOPPING) {
+            if (pendingTasks == 0) {
+                // nothing is scanned at the moment, so this is the start of a new scan
+                scanStartTime = std::chrono::steady_clock::now();
+                updateDiskSpace();
             }
+            scanQueue.pop(request);
+            scanQueueSize = scanQueue.size();
+            ++pendingTasks;
+            if (request.recursive)
+                scannedRecursively = true;
+            return true;
+        }
+    }
 
-            // if this is not a recursive scan, we need to store paths to all new dirs
-            db->setChildrenForPath(*scanRequest.path, std::move(scannedEntries),
-                                   scanRequest.recursive ? nullptr : &newPaths);
+    auto &worker = *workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        if (!worker.tasks.empty()) {
+            request = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            return true;
+        }
+    }
 
-            while (scannerStatus == ScannerStatus::SCAN_PAUSED) {
-                //if scan is paused, just wait until it isn't
-                std::this_thread::sleep_for(milliseconds(20));
-            }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        auto &victim = *workers[(workerIndex + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            request = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
 
-            scanLock.lock();
-            if (!newPaths.empty()) {
-                addChildrenToQueue(newPaths, true, false);
-                newPaths.clear();
-            }
-            checkForEvents();
+void SpaceScanner::processRequest(ScanWorker &worker, ScanRequest &request) {
+    // content of directories at max depth is not stored, so changes deep inside of them
+    // are applied by scanning the whole directory at max depth again
+    auto depthLimit = maxDepth.load();
+    auto depth = request.path->getParts().size() - rootPartCount;
+    while (depthLimit > 0 && depth > depthLimit && request.path->goUp())
+        --depth;
+    bool isAggregated = depthLimit > 0 && depth == depthLimit;
+
+    {
+        // update current scanned path with new data
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        if (worker.currentPath)
+            *worker.currentPath = *request.path;
+        else
+            worker.currentPath = Utils::make_unique<FilePath>(*request.path);
+    }
+
+    std::vector<std::unique_ptr<FileEntry>> scannedEntries;
+    std::vector<std::unique_ptr<FilePath>> newPaths;
+
+    // stamp is read before directory is listed, so any change made during listing will change it
+    PlatformUtils::DirStamp stamp{};
+    bool hasStamp = PlatformUtils::getDirStamp(request.path->getPath(), stamp);
+
+    // this is important for linux since not any path should be scanned (e.g. /proc or /sys)
+    // mount point is left as empty directory, even if it was mounted after previous scan
+    bool skipDir = hasStamp && isSkippedMount(request.path->getPath(), stamp);
+    if (skipDir && logger) {
+        auto msg = Utils::strFormat("Skip scan of: %s", request.path->getPath().c_str());
+        logger->log(msg, "SCAN");
+    }
+    // stamp of directory at max depth doesn't change when something deep inside of it is changed
+    hasStamp = hasStamp && !skipDir && !isAggregated && isStampStable(stamp);
+
+    if (!skipDir && watcher && !watcher->isRecursive()) {
+        if (watcher->addDir(request.path->getPath()) == SpaceWatcher::AddDirStatus::DIR_LIMIT_REACHED) {
+            //dir was not added, should report this
+            watcherLimitExceeded = true;
         }
-        updateDiskSpace();
-        scanQueue.clear();
-        currentScannedPath = nullptr;
-        scanLock.unlock();
-
-        auto stop = high_resolution_clock::now();
-        auto mseconds = duration_cast<milliseconds>(stop - start).count();
-        //TODO this outputs very frequently when watching for changes
-        auto msg = Utils::strFormat("Time taken: %dms. Stat: %d files, %d dirs",
-                                    mseconds, db->getFileCount(), db->getDirCount());
-        if (logger && scannedRecursively)
-            logger->log(msg, "SCAN");
-        scannerStatus = ScannerStatus::IDLE;
     }
 
-    std::cout << "End worker thread\n";
+    if (request.quick && hasStamp && db->getChildDirsIfUnchanged(*request.path, stamp, newPaths)) {
+        // directory didn't change since previous scan, so only its subdirectories are checked
+        if (request.recursive)
+            pushTasks(worker, newPaths, true);
+        --pendingTasks;
+        return;
+    }
+    newPaths.clear();
+
+    FileDB::Aggregate aggregate{};
+    if (skipDir) {
+        // mount point is left as empty directory
+    } else if (isAggregated) {
+        scanAggregateAt(*request.path, aggregate);
+    } else {
+        // if we should perform recursive scan, store all paths to dirs in vector
+        scanChildrenAt(*request.path, scannedEntries, request.recursive ? &newPaths : nullptr);
+    }
+
+    if (scannerStatus == ScannerStatus::STOPPING) {
+        --pendingTasks;
+        return;
+    }
+
+    // if this is not a recursive scan, db will store paths to all new dirs
+    FileDB::ChildrenUpdate update(std::move(request.path), std::move(scannedEntries), !request.recursive);
+    update.newPaths = std::move(newPaths);
+    update.hasStamp = hasStamp;
+    update.stamp = stamp;
+    update.hasAggregate = isAggregated;
+    update.aggregate = aggregate;
+    // watches of deleted directories should be removed, otherwise they are leaked
+    // (e.g. when directory is moved outside of scanned tree)
+    update.collectDeletedPaths = watcher && !watcher->isRecursive();
+    // when owner of hard link is deleted, file should be counted by its other link
+    update.collectDeletedFiles = !hardLinks.empty();
+    worker.pendingUpdates.push_back(std::move(update));
+    worker.pendingQuick.push_back(request.quick);
+
+    commitUpdates(worker, worker.pendingUpdates.size() >= MAX_PENDING_UPDATES);
+}
+
+bool SpaceScanner::commitUpdates(ScanWorker &worker, bool wait) {
+    if (worker.pendingUpdates.empty())
+        return false;
+
+    if (!db->setChildrenForPaths(worker.pendingUpdates, wait))
+        return false;
+
+    // all new paths should be added to database before they are scanned,
+    // otherwise we might not be able to find them when their children are set
+    // so they are added to deque only after commit
+    for (size_t i = 0; i < worker.pendingUpdates.size(); ++i) {
+        pushTasks(worker, worker.pendingUpdates[i].newPaths, worker.pendingQuick[i]);
+        for (auto &path : worker.pendingUpdates[i].deletedPaths)
+            watcher->rmDir(path->getPath());
+        releaseHardLinks(worker.pendingUpdates[i].deletedFiles);
+    }
+    // all new requests are already in deque, so it's safe to decrement
+    pendingTasks -= worker.pendingUpdates.size();
+    worker.pendingUpdates.clear();
+    worker.pendingQuick.clear();
+    return true;
+}
+
+void SpaceScanner::pushTasks(ScanWorker &worker, std::vector<std::unique_ptr<FilePath>> &paths, bool quick) {
+    if (paths.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        pendingTasks += paths.size();
+        for (auto &path : paths) {
+            ScanRequest childRequest;
+            childRequest.path = std::move(path);
+            childRequest.recursive = true;
+            childRequest.quick = quick;
+            worker.tasks.push_back(std::move(childRequest));
+        }
+    }
+    // other workers might wait for something to steal
+    wakeIdleWorkers();
+}
+
+bool SpaceScanner::isExcludedDir(const std::string &path) const {
+    return Utils::in_array(path, availableRoots) || Utils::in_array(path, excludedMounts);
+}
+
+bool SpaceScanner::isSkippedMount(const std::string &path, const PlatformUtils::DirStamp &stamp) {
+    // most directories are on the same filesystem as root, so they are not compared with mount points
+    if (hasRootMountId && stamp.mountId == rootMountId)
+        return false;
+    if (hasRootMountId && oneFileSystem)
+        return true;
+
+    std::lock_guard<std::mutex> lock(scanMtx);
+    if (!hasRootMountId)
+        return isExcludedDir(path);
+    return Utils::in_array(path, excludedMounts);
+}
+
+bool SpaceScanner::isStampStable(const PlatformUtils::DirStamp &stamp) {
+    using namespace std::chrono;
+    // timestamps of filesystem have limited precision, so directory that was changed
+    // just now might change again without changing its stamp
+    // such stamps are not stored, so directory will be listed by the next scan
+    auto now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    auto threshold = int64_t(now) - STABLE_STAMP_AGE_NS;
+    return stamp.modifyTime < threshold && stamp.changeTime < threshold;
+}
+
+void SpaceScanner::clearRequests() {
+    scanQueue.clear();
+    scanQueueSize = 0;
+    for (auto &worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        pendingTasks -= worker->tasks.size();
+        worker->tasks.clear();
+    }
+}
+
+bool SpaceScanner::hasRequests() {
+    if (!runWorker || !scanQueue.empty())
+        return true;
+    for (auto &worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        if (!worker->tasks.empty())
+            return true;
+    }
+    return false;
+}
+
+void SpaceScanner::wakeIdleWorkers() {
+    if (idleWorkers == 0)
+        return;
+    {
+        // worker checks for requests and starts waiting while holding scan mutex
+        // so locking it here guarantees that notification is not lost
+        std::lock_guard<std::mutex> lock(scanMtx);
+    }
+    scanCv.notify_all();
+}
+
+void SpaceScanner::finishScanIfDone() {
+    if (scannerStatus == ScannerStatus::IDLE || scannerStatus == ScannerStatus::SCAN_PAUSED ||
+        !scanQueue.empty() || pendingTasks > 0)
+        return;
+
+    updateDiskSpace();
+
+    using namespace std::chrono;
+    auto mseconds = duration_cast<milliseconds>(steady_clock::now() - scanStartTime).count();
+    //TODO this outputs very frequently when watching for changes
+    auto msg = Utils::strFormat("Time taken: %dms. Stat: %d files, %d dirs",
+                                mseconds, db->getFileCount(), db->getDirCount());
+    if (logger && scannedRecursively)
+        logger->log(msg, "SCAN");
+    scannedRecursively = false;
+    scannerStatus = ScannerStatus::IDLE;
+    scanCv.notify_all();
 }
 
 void SpaceScanner::scanChildrenAt(const FilePath &path,
                                   std::vector<std::unique_ptr<FileEntry>> &scannedEntries,
                                   std::vector<std::unique_ptr<FilePath>> *newPaths) {
     auto pathStr = path.getPath();
+    // links are identified by hash of their path, so the same link is recognized in every scan
+    auto pathHash = FileEntryIndex::hashName(pathStr.c_str(), pathStr.size());
 
     //TODO add check if iterator was constructed and we were able to open path
     for (auto it = FileIterator::create(pathStr); it->isValid(); ++(*it)) {
+        // mount points are detected when their own requests are processed
         bool doScan = it->isDir();
         std::unique_ptr<FilePath> entryPath;
-        // this section is important for linux since not any path should be scanned (e.g. /proc or /sys)
-        if (doScan && scannerStatus != ScannerStatus::STOPPING) {
-            std::string newPath = pathStr;
-            if (newPath.back() != PlatformUtils::filePathSeparator)
-                newPath.push_back(PlatformUtils::filePathSeparator);
-            newPath.append(it->getName());
-            if (newPath.back() != PlatformUtils::filePathSeparator)
-                newPath.push_back(PlatformUtils::filePathSeparator);
-            if (Utils::in_array(newPath, availableRoots) || Utils::in_array(newPath, excludedMounts)) {
-                doScan = false;
-                if (logger) {
-                    auto msg = Utils::strFormat("Skip scan of: %s", newPath.c_str());
-                    logger->log(msg, "SCAN");
-                }
-            }
-        }
-        auto fe = Utils::make_unique<FileEntry>(it->getName(), it->isDir(), it->getSize());
+        auto fe = FileEntry::create(it->getName(), it->isDir(), getCountedSize(*it, pathStr, pathHash));
         if (doScan && newPaths) {
             entryPath = Utils::make_unique<FilePath>(path);
             entryPath->addDir(it->getName(), fe->getNameCrc());
@@ -207,84 +479,100 @@ void SpaceScanner::scanChildrenAt(const FilePath &path,
     }
 }
 
-void SpaceScanner::addChildrenToQueue(std::vector<std::unique_ptr<FilePath>> &paths, bool recursiveScan, bool toBack) {
-    //create parent for children
-    FilePath parent = *paths.front();
-    parent.goUp();
-
-    bool safeToBatchAdd = true;
-    auto it = scanQueue.begin();
-
-    while (it != scanQueue.end()) {
-        auto res = parent.compareTo(*(*it).path);
-
-        if (res == FilePath::CompareResult::DIFFERENT)
-            ++it;
-        else if (res == FilePath::CompareResult::CHILD && it->recursive)
-            //if parent of entries is child to some recursive scan request, then we don't need to add
-            return;
-        else {
-            safeToBatchAdd = false;
-            break;
-        }
-    }
-    if (safeToBatchAdd) {
-        for (auto &child : paths) {
-            ScanRequest request;
-            request.path = std::move(child);
-            request.recursive = recursiveScan;
-
-            if (toBack)
-                scanQueue.push_back(std::move(request));
-            else
-                scanQueue.push_front(std::move(request));
+void SpaceScanner::scanAggregateAt(const FilePath &path, FileDB::Aggregate &aggregate) {
+    aggregate = FileDB::Aggregate{};
+    // subtree is scanned depth-first, only paths to directories that are not listed yet are stored
+    std::vector<std::string> dirs;
+    dirs.push_back(path.getPath());
+    while (!dirs.empty() && scannerStatus != ScannerStatus::STOPPING) {
+        auto dirPath = std::move(dirs.back());
+        dirs.pop_back();
+        auto pathHash = FileEntryIndex::hashName(dirPath.c_str(), dirPath.size());
+
+        for (auto it = FileIterator::create(dirPath); it->isValid(); ++(*it)) {
+            aggregate.size += getCountedSize(*it, dirPath, pathHash);
+            if (!it->isDir()) {
+                ++aggregate.fileCount;
+                continue;
+            }
+            ++aggregate.dirCount;
+
+            auto childPath = dirPath + it->getName() + PlatformUtils::filePathSeparator;
+            PlatformUtils::DirStamp stamp{};
+            if (PlatformUtils::getDirStamp(childPath, stamp) && isSkippedMount(childPath, stamp))
+                continue;
+            // changes inside of subtree are reported for its directories,
+            // they are then mapped to directory at max depth
+            if (watcher && !watcher->isRecursive() &&
+                watcher->addDir(childPath) == SpaceWatcher::AddDirStatus::DIR_LIMIT_REACHED)
+                watcherLimitExceeded = true;
+            dirs.push_back(std::move(childPath));
         }
-    } else {
-        // Adding all children separately
-        // most of the times this will not happen
-        for (auto &child : paths)
-            addToQueue(std::move(child), recursiveScan, toBack);
     }
-
 }
 
-void SpaceScanner::addToQueue(std::unique_ptr<FilePath> path, bool recursiveScan, bool toBack) {
-    auto it = scanQueue.begin();
-
-    while (it != scanQueue.end()) {
-        auto res = path->compareTo(*(*it).path);
+int64_t SpaceScanner::getCountedSize(const FileIterator &it, const std::string &dirPath, uint64_t dirHash) {
+    auto size = db->getSizeMode() == SizeMode::ON_DISK ? it.getAllocatedSize() : it.getSize();
+    uint64_t device, inode;
+    if (it.getHardLinkId(device, inode)) {
+        auto &name = it.getName();
+        auto linkHash = dirHash ^ FileEntryIndex::hashName(name.c_str(), name.size());
+        if (!hardLinks.claim(device, inode, static_cast<uint32_t>(linkHash), dirPath))
+            size = 0; // file is already counted by another link
+    }
+    return size;
+}
 
-        if (res == FilePath::CompareResult::DIFFERENT || res == FilePath::CompareResult::CHILD)
-            ++it;
-        else if (res == FilePath::CompareResult::PARENT)
-            //if we are parent path to some path in queue, then we should remove it from queue
-            it = scanQueue.erase(it);
-        else //equal
-        {
-            scanQueue.erase(it);
-            break;
-        }
+void SpaceScanner::releaseHardLinks(const std::vector<std::unique_ptr<FilePath>> &deletedFiles) {
+    std::vector<std::string> linkDirs;
+    for (auto &file : deletedFiles) {
+        auto name = file->getName();
+        FilePath dir(*file);
+        dir.goUp();
+        // owner is computed the same way as in getCountedSize
+        auto dirPath = dir.getPath();
+        auto linkHash = FileEntryIndex::hashName(dirPath.c_str(), dirPath.size()) ^
+                        FileEntryIndex::hashName(name.c_str(), name.size());
+        hardLinks.release(static_cast<uint32_t>(linkHash), linkDirs);
     }
+    if (linkDirs.empty())
+        return;
 
-    ScanRequest request;
-    request.path = std::move(path);
-    request.recursive = recursiveScan;
+    std::lock_guard<std::mutex> lock(scanMtx);
+    auto root = db->getRootPath().getRoot();
+    for (auto &linkDir : linkDirs)
+        addToQueue(Utils::make_unique<FilePath>(linkDir, root), false);
+}
 
-    if (toBack)
-        scanQueue.push_back(std::move(request));
-    else
-        scanQueue.push_front(std::move(request));
+void SpaceScanner::addToQueue(std::unique_ptr<FilePath> path, bool recursiveScan, bool toBack,
+                              bool quickScan) {
+    scanQueue.push(std::move(path), recursiveScan, quickScan, toBack);
+    scanQueueSize = scanQueue.size();
+    scanCv.notify_all();
 }
 
 const FileDB& SpaceScanner::getFileDB() const {
     return *db;
 }
 
-std::unique_ptr<FilePath> SpaceScanner::getCurrentScanPath() {
-    std::lock_guard<std::mutex> lock_mtx(scanMtx);
+SizeMode SpaceScanner::getSizeMode() const {
+    return db->getSizeMode();
+}
+
+bool SpaceScanner::saveSnapshot(const std::string &snapshotPath) const {
+    return db->saveSnapshot(snapshotPath);
+}
+
+bool SpaceScanner::isLoadedFromSnapshot() const {
+    return loadedFromSnapshot;
+}
 
-    if (currentScannedPath) {
-        return Utils::make_unique<FilePath>(*currentScannedPath);
+std::unique_ptr<FilePath> SpaceScanner::getCurrentScanPath() {
+    // any of currently scanned paths is good enough
+    for (auto &worker : workers) {
+        std::lock_guard<std::mutex> lock_mtx(worker->mtx);
+        if (worker->currentPath)
+            return Utils::make_unique<FilePath>(*worker->currentPath);
     }
     return nullptr;
 }
@@ -332,6 +620,7 @@ bool SpaceScanner::resumeScan() {
     std::lock_guard<std::mutex> lock_mtx(scanMtx);
     if (scannerStatus == ScannerStatus::SCAN_PAUSED) {
         scannerStatus = ScannerStatus::SCANNING;
+        scanCv.notify_all();
         return true;
     }
     return false;
@@ -346,14 +635,13 @@ bool SpaceScanner::canResume() {
 }
 
 void SpaceScanner::stopScan() {
-    {
-        std::lock_guard<std::mutex> lock_mtx(scanMtx);
-        if (scannerStatus != ScannerStatus::STOPPING && scannerStatus != ScannerStatus::IDLE)
-            scannerStatus = ScannerStatus::STOPPING;
+    std::unique_lock<std::mutex> lock_mtx(scanMtx);
+    if (scannerStatus != ScannerStatus::STOPPING && scannerStatus != ScannerStatus::IDLE) {
+        scannerStatus = ScannerStatus::STOPPING;
+        scanCv.notify_all();
     }
     //wait until everything is stopped
-    while (scannerStatus != ScannerStatus::IDLE)
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    scanCv.wait(lock_mtx, [this]() { return scannerStatus == ScannerStatus::IDLE; });
 }
 
 void SpaceScanner::updateDiskSpace() {
@@ -365,7 +653,7 @@ void SpaceScanner::updateDiskSpace() {
     db->setSpace(total, available);
 }
 
-void SpaceScanner::rescanPath(const FilePath &folder_path) {
+void SpaceScanner::rescanPath(const FilePath &folder_path, bool quick) {
     std::lock_guard<std::mutex> lock_mtx(scanMtx);
     auto entry = db->findEntry(folder_path);
 
@@ -379,8 +667,12 @@ void SpaceScanner::rescanPath(const FilePath &folder_path) {
 
     updateDiskSpace();//disk space might change since last update, so update it again
 
+    // all links will be found again, so files that were deleted since last scan are forgotten
+    if (!quick && folder_path.getPath() == db->getRootPath().getPath())
+        hardLinks.clear();
+
     // pushing to front so we start rescanning as soon as possible
-    addToQueue(Utils::make_unique<FilePath>(folder_path), true, false);
+    addToQueue(Utils::make_unique<FilePath>(folder_path), true, false, quick);
 }
 
 void SpaceScanner::getSpace(int64_t &used, int64_t &available, int64_t &total) const {
@@ -399,6 +691,39 @@ const FilePath &SpaceScanner::getRootPath() const {
     return db->getRootPath();
 }
 
+int64_t SpaceScanner::getWatcherUserWatchCount() const {
+    return watcher ? watcher->getUserWatchCount() : -1;
+}
+
+int64_t SpaceScanner::getWatcherLostEventsCount() const {
+    return watcher ? watcher->getLostEventsCount() : 0;
+}
+
+void SpaceScanner::setWatcherDebounce(std::chrono::milliseconds window) {
+    if (watcher)
+        watcher->setCoalescing(true, window);
+}
+
+void SpaceScanner::setOneFileSystem(bool enabled) {
+    oneFileSystem = enabled;
+}
+
+bool SpaceScanner::isOneFileSystem() const {
+    return oneFileSystem;
+}
+
+bool SpaceScanner::setMemoryBudget(int64_t bytes, const std::string &spillPath) {
+    return db->setMemoryBudget(bytes, spillPath);
+}
+
+void SpaceScanner::setMaxDepth(unsigned depth) {
+    maxDepth = depth;
+}
+
+unsigned SpaceScanner::getMaxDepth() const {
+    return maxDepth;
+}
+
 void SpaceScanner::setLogger(std::shared_ptr<Logger> logger_) {
     logger = std::move(logger_);
 }
@@ -1,14 +1,18 @@
 #include "spacewatcher.h"
+#include "utils.h"
 
 #include <iostream>
 
 SpaceWatcher::~SpaceWatcher() {
-    runThread = false;
-    watchThread.join();
+    stopThread();
 }
 
 int64_t SpaceWatcher::getWatchedDirCount() const {
-    return getDirCountLimit() < 0 ? 1 : watchedDirCount;
+    return getDirCountLimit() < 0 ? 1 : watchedDirCount.load();
+}
+
+int64_t SpaceWatcher::getLostEventsCount() const {
+    return lostEventsCount;
 }
 
 SpaceWatcher::AddDirStatus SpaceWatcher::addDir(const std::string &path) {
@@ -23,33 +27,116 @@ void SpaceWatcher::rmDir(const std::string &path) {
 
 std::unique_ptr<SpaceWatcher::FileEvent> SpaceWatcher::popEvent() {
     std::lock_guard<std::mutex> lock(eventsMtx);
-    if (!eventQueue.empty()) {
-        auto event = std::move(eventQueue.front());
-        eventQueue.pop_front();
-        return event;
-    }
-    return nullptr;
+    // all events have the same debounce window so the front one is always the first to be ready
+    if (eventQueue.empty() || eventQueue.front().readyTime > std::chrono::steady_clock::now())
+        return nullptr;
+
+    auto event = std::move(eventQueue.front().event);
+    eventQueue.pop_front();
+    auto it = queuedByParent.find(event->parentpath);
+    if (it != queuedByParent.end() && it->second == event.get())
+        queuedByParent.erase(it);
+    return event;
+}
+
+void SpaceWatcher::setCoalescing(bool enabled, std::chrono::milliseconds window) {
+    std::lock_guard<std::mutex> lock(eventsMtx);
+    coalesceEvents = enabled;
+    debounceWindow = enabled ? window : std::chrono::milliseconds(0);
+    // events that are already in queue are not merged with new ones anymore
+    queuedByParent.clear();
+}
+
+bool SpaceWatcher::getNextEventTime(std::chrono::steady_clock::time_point &time) {
+    std::lock_guard<std::mutex> lock(eventsMtx);
+    if (eventQueue.empty())
+        return false;
+    time = eventQueue.front().readyTime;
+    return true;
 }
 
-SpaceWatcher::SpaceWatcher() : runThread(true), watchedDirCount(0) {
-    //Start thread after everything is initialized
+void SpaceWatcher::setEventListener(std::function<void()> listener) {
+    std::lock_guard<std::mutex> lock(eventsMtx);
+    eventListener = std::move(listener);
+}
+
+SpaceWatcher::SpaceWatcher() : runThread(true), watchedDirCount(0), lostEventsCount(0), coalesceEvents(false),
+                               debounceWindow(0) {
+
+}
+
+void SpaceWatcher::wakeUp() {
+
+}
+
+void SpaceWatcher::startThread() {
     watchThread = std::thread(&SpaceWatcher::watcherRun, this);
 }
 
+void SpaceWatcher::stopThread() {
+    if (!watchThread.joinable())
+        return;
+    runThread = false;
+    wakeUp();
+    watchThread.join();
+}
+
 void SpaceWatcher::addEvent(std::unique_ptr<FileEvent> event) {
     if (!event)
         return;
 
-    std::lock_guard<std::mutex> lock(eventsMtx);
-    //TODO check if we already have the same events in queue
-    eventQueue.push_back(std::move(event));
+    std::function<void()> listener;
+    {
+        std::lock_guard<std::mutex> lock(eventsMtx);
+        if (coalesceEvents) {
+            auto it = queuedByParent.find(event->parentpath);
+            if (it != queuedByParent.end()) {
+                // consumer is interested only in changed directory, so it will get one event for all changes
+                auto &queued = *it->second;
+                if (queued.action == FileAction::EVENTS_LOST)
+                    return;
+                if (event->action == FileAction::EVENTS_LOST) {
+                    queued.action = FileAction::EVENTS_LOST;
+                    queued.filepath = queued.parentpath;
+                } else if (queued.action != event->action || queued.filepath != event->filepath) {
+                    queued.action = FileAction::MODIFIED;
+                    queued.filepath = queued.parentpath;
+                }
+                return;
+            }
+            queuedByParent[event->parentpath] = event.get();
+        } else if (!eventQueue.empty()) {
+            // event that repeats the last unread one doesn't tell anything new
+            // (e.g. file is truncated and then written), inotify merges such events the same way
+            auto &last = *eventQueue.back().event;
+            if (last.action == event->action && last.filepath == event->filepath)
+                return;
+        }
+        // consumer always takes all events, so it should be notified only about the first one
+        if (eventQueue.empty())
+            listener = eventListener;
+        QueuedEvent queued;
+        queued.event = std::move(event);
+        queued.readyTime = std::chrono::steady_clock::now() + debounceWindow;
+        eventQueue.push_back(std::move(queued));
+    }
+    // listener is called without lock so it can use any other locks
+    if (listener)
+        listener();
+}
+
+void SpaceWatcher::reportLostEvents(const std::string &path) {
+    ++lostEventsCount;
+    auto event = Utils::make_unique<FileEvent>();
+    event->action = FileAction::EVENTS_LOST;
+    event->filepath = path;
+    event->parentpath = path;
+    addEvent(std::move(event));
 }
 
 void SpaceWatcher::watcherRun() {
     std::cout << "Start watcher thread\n";
-    while (runThread) {
+    while (runThread)
         readEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
     std::cout << "Stop watcher thread\n";
 }
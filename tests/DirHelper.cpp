@@ -9,12 +9,14 @@
 #if _WIN32
 
 #include <direct.h>
+#include <Windows.h>
 
 #define mkdir(dir, mode) _mkdir(dir)
 #define rmdir(dir) _rmdir(dir)
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 
@@ -40,7 +42,7 @@ bool DirHelper::createDir(const std::string &path) {
     return mkdir(newPath.getPath().c_str(), 0755) == 0;
 }
 
-bool DirHelper::createFile(const std::string &path) {
+bool DirHelper::createFile(const std::string &path, size_t size) {
     if (!root)
         return false;
 
@@ -49,12 +51,30 @@ bool DirHelper::createFile(const std::string &path) {
 
     auto f = fopen(newPath.getPath().c_str(), "w+");
     if (f) {
+        for (size_t i = 0; i < size; ++i)
+            fputc('0', f);
         fclose(f);
         return true;
     }
     return false;
 }
 
+bool DirHelper::createHardLink(const std::string &targetPath, const std::string &path) {
+    if (!root)
+        return false;
+
+    auto target = *root;
+    target.addFile(targetPath);
+    auto newPath = *root;
+    newPath.addFile(path);
+
+#if _WIN32
+    return CreateHardLinkA(newPath.getPath().c_str(), target.getPath().c_str(), nullptr) != 0;
+#else
+    return link(target.getPath().c_str(), newPath.getPath().c_str()) == 0;
+#endif
+}
+
 bool DirHelper::deleteDir(const std::string &path) {
     if (!root)
         return false;
@@ -65,6 +85,16 @@ bool DirHelper::deleteDir(const std::string &path) {
     return PlatformUtils::deleteDir(newPath.getPath());
 }
 
+bool DirHelper::deleteFile(const std::string &path) {
+    if (!root)
+        return false;
+
+    auto newPath = *root;
+    newPath.addFile(path);
+
+    return std::remove(newPath.getPath().c_str()) == 0;
+}
+
 bool DirHelper::rename(const std::string &oldPath, const std::string &newPath) {
     if (!root)
         return false;
@@ -19,10 +19,20 @@ public:
 
     bool createDir(const std::string &path);
 
-    bool createFile(const std::string &path);
+    bool createFile(const std::string &path, size_t size = 0);
+
+    /**
+     * Creates hard link of existing file
+     * @param targetPath - path to existing file
+     * @param path - path of new link
+     * @return
+     */
+    bool createHardLink(const std::string &targetPath, const std::string &path);
 
     bool deleteDir(const std::string &path);
 
+    bool deleteFile(const std::string &path);
+
     bool rename(const std::string &oldPath, const std::string &newPath);
 
 private:
@@ -0,0 +1,80 @@
+#include "EntryTable.h"
+#include "fileentry.h"
+#include "utils.h"
+
+#include <cstring>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Entry table allocations", "[entry-table]")
+{
+    EntryTable table(40);
+
+    SECTION("Objects are found by their references")
+    {
+        std::vector<std::pair<void *, uint32_t>> objects;
+        bool isValid = true;
+        for (int i = 0; i < 100000; ++i) {
+            uint32_t ref;
+            auto ptr = table.allocate(ref);
+            isValid &= ref != EntryTable::nullRef && ref < EntryTable::maxRef;
+            memset(ptr, i % 256, 40);
+            objects.emplace_back(ptr, ref);
+        }
+        REQUIRE(isValid);
+        REQUIRE(table.getObjectCount() == 100000);
+
+        bool isFound = true;
+        bool isIntact = true;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            auto ptr = static_cast<uint8_t *>(objects[i].first);
+            isFound &= table.get(objects[i].second) == ptr;
+            isFound &= table.getRef(ptr) == objects[i].second;
+            for (size_t j = 0; j < 40; ++j)
+                isIntact &= ptr[j] == i % 256;
+        }
+        REQUIRE(isFound);
+        REQUIRE(isIntact);
+
+        auto reserved = table.getReservedSize();
+        for (auto &obj : objects)
+            table.deallocate(obj.first);
+        REQUIRE(table.getObjectCount() == 0);
+        // empty chunks are released
+        REQUIRE(table.getReservedSize() < reserved / 2);
+    }
+
+    SECTION("Freed slots are reused")
+    {
+        uint32_t ref1, ref2;
+        auto first = table.allocate(ref1);
+        table.deallocate(first);
+        auto second = table.allocate(ref2);
+        REQUIRE(first == second);
+        REQUIRE(ref1 == ref2);
+        table.deallocate(second);
+    }
+}
+
+TEST_CASE("FileEntry references", "[entry-table]")
+{
+    // root on stack and root allocated in table should behave the same
+    FileEntry stackRoot("/root/", true);
+    auto heapRoot = FileEntry::create("/root/", true);
+
+    for (auto root : {&stackRoot, heapRoot.get()}) {
+        auto dir = FileEntry::create("dir", true);
+        auto dirPtr = dir.get();
+        root->addChild(std::move(dir));
+        auto file = FileEntry::create("file", false, 10);
+        auto filePtr = file.get();
+        dirPtr->addChild(std::move(file));
+
+        REQUIRE(filePtr->getParent() == dirPtr);
+        REQUIRE(dirPtr->getParent() == root);
+        REQUIRE(root->getSize() == 10);
+        REQUIRE_FALSE(dirPtr->isRoot());
+        REQUIRE(root->isRoot());
+    }
+}
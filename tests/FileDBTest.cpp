@@ -2,8 +2,12 @@
 #include "filepath.h"
 #include "fileentry.h"
 #include "utils.h"
+#include "platformutils.h"
 
 #include <cstring>
+#include <thread>
+#include <fstream>
+#include <cstdio>
 
 #include <catch2/catch_test_macros.hpp>
 
@@ -23,9 +27,9 @@ TEST_CASE("FileDB construction", "[filedb]")
 
     SECTION("Can add to root")
     {
-        entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
-        entries.push_back(Utils::make_unique<FileEntry>("dir2", true));
-        entries.push_back(Utils::make_unique<FileEntry>("dir3", true));
+        entries.push_back(FileEntry::create("dir1", true));
+        entries.push_back(FileEntry::create("dir2", true));
+        entries.push_back(FileEntry::create("dir3", true));
 
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries), &newPaths));
         REQUIRE(newPaths.size() == 3);
@@ -34,11 +38,11 @@ TEST_CASE("FileDB construction", "[filedb]")
 
     SECTION("Can add to existing path")
     {
-        entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
+        entries.push_back(FileEntry::create("dir1", true));
         db.setChildrenForPath(rootPath, std::move(entries));
 
-        entries.push_back(Utils::make_unique<FileEntry>("dir2", true));
-        entries.push_back(Utils::make_unique<FileEntry>("dir3", true));
+        entries.push_back(FileEntry::create("dir2", true));
+        entries.push_back(FileEntry::create("dir3", true));
 
         rootPath.addDir("dir1");
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries), &newPaths));
@@ -56,10 +60,10 @@ TEST_CASE("FileDB construction", "[filedb]")
 
     SECTION("Can't add to file path")
     {
-        entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
+        entries.push_back(FileEntry::create("dir1", true));
         db.setChildrenForPath(rootPath, std::move(entries));
 
-        entries.push_back(Utils::make_unique<FileEntry>("file1", false, 10));
+        entries.push_back(FileEntry::create("file1", false, 10));
         rootPath.addFile("dir1");
         REQUIRE_FALSE(db.setChildrenForPath(rootPath, std::move(entries), &newPaths));
         REQUIRE(newPaths.empty());
@@ -68,7 +72,7 @@ TEST_CASE("FileDB construction", "[filedb]")
 
     SECTION("Setting empty array clears children")
     {
-        entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
+        entries.push_back(FileEntry::create("dir1", true));
         db.setChildrenForPath(rootPath, std::move(entries));
         REQUIRE(db.getDirCount() == 2);
 
@@ -79,32 +83,32 @@ TEST_CASE("FileDB construction", "[filedb]")
 
     SECTION("Stats count all children")
     {
-        entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
-        entries.push_back(Utils::make_unique<FileEntry>("dir2", true));
-        entries.push_back(Utils::make_unique<FileEntry>("dir3", true));
+        entries.push_back(FileEntry::create("dir1", true));
+        entries.push_back(FileEntry::create("dir2", true));
+        entries.push_back(FileEntry::create("dir3", true));
 
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries)));
 
-        entries.push_back(Utils::make_unique<FileEntry>("file1", false, 10));
-        entries.push_back(Utils::make_unique<FileEntry>("file2", false, 30));
-        entries.push_back(Utils::make_unique<FileEntry>("file3", false, 20));
+        entries.push_back(FileEntry::create("file1", false, 10));
+        entries.push_back(FileEntry::create("file2", false, 30));
+        entries.push_back(FileEntry::create("file3", false, 20));
 
         rootPath.addDir("dir1");
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries)));
 
         rootPath.goUp();
         rootPath.addDir("dir2");
-        entries.push_back(Utils::make_unique<FileEntry>("file4", false, 15));
-        entries.push_back(Utils::make_unique<FileEntry>("file5", false, 35));
-        entries.push_back(Utils::make_unique<FileEntry>("file6", false, 25));
+        entries.push_back(FileEntry::create("file4", false, 15));
+        entries.push_back(FileEntry::create("file5", false, 35));
+        entries.push_back(FileEntry::create("file6", false, 25));
 
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries)));
 
         rootPath.goUp();
         rootPath.addDir("dir3");
-        entries.push_back(Utils::make_unique<FileEntry>("file7", false, 15));
-        entries.push_back(Utils::make_unique<FileEntry>("file8", false, 35));
-        entries.push_back(Utils::make_unique<FileEntry>("file9", false, 25));
+        entries.push_back(FileEntry::create("file7", false, 15));
+        entries.push_back(FileEntry::create("file8", false, 35));
+        entries.push_back(FileEntry::create("file9", false, 25));
 
         REQUIRE(db.setChildrenForPath(rootPath, std::move(entries)));
 
@@ -124,15 +128,15 @@ void createSampleDb(FileDB &db) {
     FilePath path = db.getRootPath();
     std::vector<std::unique_ptr<FileEntry>> entries;
 
-    entries.push_back(Utils::make_unique<FileEntry>("dir1", true));
-    entries.push_back(Utils::make_unique<FileEntry>("dir2", true));
-    entries.push_back(Utils::make_unique<FileEntry>("dir3", true));
+    entries.push_back(FileEntry::create("dir1", true));
+    entries.push_back(FileEntry::create("dir2", true));
+    entries.push_back(FileEntry::create("dir3", true));
 
     db.setChildrenForPath(path, std::move(entries));
 
-    entries.push_back(Utils::make_unique<FileEntry>("file1", false, 10));
-    entries.push_back(Utils::make_unique<FileEntry>("file2", false, 30));
-    entries.push_back(Utils::make_unique<FileEntry>("file3", false, 20));
+    entries.push_back(FileEntry::create("file1", false, 10));
+    entries.push_back(FileEntry::create("file2", false, 30));
+    entries.push_back(FileEntry::create("file3", false, 20));
 
     path.goUp();
     path.addDir("dir1");
@@ -140,17 +144,17 @@ void createSampleDb(FileDB &db) {
 
     path.goUp();
     path.addDir("dir2");
-    entries.push_back(Utils::make_unique<FileEntry>("file4", false, 15));
-    entries.push_back(Utils::make_unique<FileEntry>("file5", false, 35));
-    entries.push_back(Utils::make_unique<FileEntry>("file6", false, 25));
+    entries.push_back(FileEntry::create("file4", false, 15));
+    entries.push_back(FileEntry::create("file5", false, 35));
+    entries.push_back(FileEntry::create("file6", false, 25));
 
     db.setChildrenForPath(path, std::move(entries));
 
     path.goUp();
     path.addDir("dir3");
-    entries.push_back(Utils::make_unique<FileEntry>("file7", false, 15));
-    entries.push_back(Utils::make_unique<FileEntry>("file8", false, 35));
-    entries.push_back(Utils::make_unique<FileEntry>("file9", false, 25));
+    entries.push_back(FileEntry::create("file7", false, 15));
+    entries.push_back(FileEntry::create("file8", false, 35));
+    entries.push_back(FileEntry::create("file9", false, 25));
 
     db.setChildrenForPath(path, std::move(entries));
 
@@ -211,7 +215,7 @@ TEST_CASE("FileDB searching", "[filedb]")
         REQUIRE(processed);
         path.goUp();
         path.addFile("file4");
-        processed = db.processEntry(path, [](const FileEntry &entry) {
+        processed = db.processEntry(path, [](const FileEntry &) {
             REQUIRE(false); // not executed
         });
         REQUIRE_FALSE(processed);
@@ -238,9 +242,9 @@ TEST_CASE("FileDB modification", "[filedb]")
             path.goUp();
 
             std::vector<std::unique_ptr<FileEntry>> entries;
-            entries.push_back(Utils::make_unique<FileEntry>("file2", false, 128));
-            entries.push_back(Utils::make_unique<FileEntry>("file3", false, 20));
-            entries.push_back(Utils::make_unique<FileEntry>("file5", false, 64));
+            entries.push_back(FileEntry::create("file2", false, 128));
+            entries.push_back(FileEntry::create("file3", false, 20));
+            entries.push_back(FileEntry::create("file5", false, 64));
 
             REQUIRE(db.setChildrenForPath(path, std::move(entries)));
             REQUIRE(db.getFileCount() == 9);
@@ -269,8 +273,8 @@ TEST_CASE("FileDB modification", "[filedb]")
             REQUIRE(oldDir != nullptr);
 
             std::vector<std::unique_ptr<FileEntry>> entries;
-            entries.push_back(Utils::make_unique<FileEntry>("dir2", true));
-            entries.push_back(Utils::make_unique<FileEntry>("dir5", true, 64));
+            entries.push_back(FileEntry::create("dir2", true));
+            entries.push_back(FileEntry::create("dir5", true, 64));
 
             REQUIRE(db.setChildrenForPath(path, std::move(entries)));
             REQUIRE(db.getFileCount() == 3);
@@ -310,3 +314,398 @@ TEST_CASE("FileDB modification", "[filedb]")
         }
     }
 }
+
+TEST_CASE("FileDB batch modification", "[filedb]")
+{
+    FilePath path("/home/");
+    FileDB db(path.getRoot());
+
+    std::vector<FileDB::ChildrenUpdate> updates;
+    std::vector<std::unique_ptr<FileEntry>> entries;
+    entries.push_back(FileEntry::create("dir1", true));
+    entries.push_back(FileEntry::create("file1", false, 10));
+    updates.emplace_back(Utils::make_unique<FilePath>(path), std::move(entries), true);
+
+    // children of new dir can be set in the same batch
+    auto dirPath = Utils::make_unique<FilePath>(path);
+    dirPath->addDir("dir1");
+    entries.push_back(FileEntry::create("file2", false, 20));
+    entries.push_back(FileEntry::create("file3", false, 30));
+    updates.emplace_back(std::move(dirPath), std::move(entries), false);
+
+    SECTION("Updates are applied in order")
+    {
+        REQUIRE(db.setChildrenForPaths(updates));
+        REQUIRE(db.getDirCount() == 2);
+        REQUIRE(db.getFileCount() == 3);
+        REQUIRE(updates[0].newPaths.size() == 1);
+        REQUIRE(updates[0].newPaths[0]->getName() == "dir1");
+        REQUIRE(updates[1].newPaths.empty());
+
+        path.addDir("dir1");
+        path.addFile("file3");
+        auto entry = db.findEntry(path);
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->getSize() == 30);
+        REQUIRE(entry->getParent()->getSize() == 50);
+    }
+
+    SECTION("Readers don't block each other, but block changes")
+    {
+        bool processed = db.processEntry(path, [&db, &path, &updates](const FileEntry &entry) {
+            // db is read from another thread while it is read from this one
+            const FileEntry *found = nullptr;
+            std::thread reader([&db, &path, &found]() {
+                found = db.findEntry(path);
+            });
+            reader.join();
+            REQUIRE(found == &entry);
+
+            REQUIRE_FALSE(db.setChildrenForPaths(updates, false));
+        });
+        REQUIRE(processed);
+        // nothing was consumed, so updates can be applied later
+        REQUIRE(updates[0].entries.size() == 2);
+        REQUIRE(db.getFileCount() == 0);
+
+        REQUIRE(db.setChildrenForPaths(updates, false));
+        REQUIRE(db.getFileCount() == 3);
+    }
+
+    SECTION("Paths of deleted directories are collected")
+    {
+        REQUIRE(db.setChildrenForPaths(updates));
+        updates.clear();
+
+        entries.push_back(FileEntry::create("file1", false, 10));
+        updates.emplace_back(Utils::make_unique<FilePath>(path), std::move(entries), false);
+        updates[0].collectDeletedPaths = true;
+        REQUIRE(db.setChildrenForPaths(updates));
+
+        // only deleted directory is reported, not files inside of it
+        REQUIRE(updates[0].deletedPaths.size() == 1);
+        path.addDir("dir1");
+        REQUIRE(updates[0].deletedPaths[0]->getPath() == path.getPath());
+        REQUIRE(db.getDirCount() == 1);
+        REQUIRE(db.getFileCount() == 1);
+    }
+}
+
+TEST_CASE("FileDB aggregated directories", "[filedb]")
+{
+    FilePath path("/home/");
+    FileDB db(path.getRoot());
+
+    std::vector<std::unique_ptr<FileEntry>> entries;
+    entries.push_back(FileEntry::create("dir1", true));
+    entries.push_back(FileEntry::create("file1", false, 10));
+    REQUIRE(db.setChildrenForPath(path, std::move(entries)));
+
+    FilePath dirPath(path);
+    dirPath.addDir("dir1");
+    entries.push_back(FileEntry::create("file2", false, 20));
+    REQUIRE(db.setChildrenForPath(dirPath, std::move(entries)));
+
+    std::vector<FileDB::ChildrenUpdate> updates;
+    updates.emplace_back(Utils::make_unique<FilePath>(dirPath), std::move(entries), false);
+    updates.back().hasAggregate = true;
+    updates.back().aggregate = FileDB::Aggregate{500, 10, 2};
+    REQUIRE(db.setChildrenForPaths(updates));
+
+    FileDB::Aggregate aggregate{};
+    REQUIRE(db.getAggregate(dirPath, aggregate));
+    REQUIRE(aggregate.size == 500);
+    REQUIRE(aggregate.fileCount == 10);
+    REQUIRE(aggregate.dirCount == 2);
+    REQUIRE_FALSE(db.getAggregate(path, aggregate));
+
+    // children of aggregated directory are removed, but they are still counted
+    auto dir = db.findEntry(dirPath);
+    REQUIRE(dir->getChildCount() == 0);
+    REQUIRE(dir->getSize() == 500);
+    REQUIRE(dir->getParent()->getSize() == 510);
+    REQUIRE(db.getFileCount() == 11);
+    REQUIRE(db.getDirCount() == 4);
+
+    SECTION("Aggregate is replaced by children")
+    {
+        entries.push_back(FileEntry::create("file3", false, 30));
+        REQUIRE(db.setChildrenForPath(dirPath, std::move(entries)));
+        REQUIRE_FALSE(db.getAggregate(dirPath, aggregate));
+        REQUIRE(dir->getSize() == 30);
+        REQUIRE(dir->getParent()->getSize() == 40);
+        REQUIRE(db.getFileCount() == 2);
+        REQUIRE(db.getDirCount() == 2);
+    }
+
+    SECTION("Aggregate is saved to snapshot")
+    {
+        const std::string snapshotPath = "TestSnapshot.bin";
+        REQUIRE(db.saveSnapshot(snapshotPath));
+        auto loaded = FileDB::loadSnapshot(snapshotPath);
+        std::remove(snapshotPath.c_str());
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getFileCount() == 11);
+        REQUIRE(loaded->getDirCount() == 4);
+        REQUIRE(loaded->getAggregate(dirPath, aggregate));
+        REQUIRE(aggregate.size == 500);
+
+        // rescan of loaded directory replaces its aggregate
+        updates.clear();
+        updates.emplace_back(Utils::make_unique<FilePath>(dirPath), std::move(entries), false);
+        updates.back().hasAggregate = true;
+        updates.back().aggregate = FileDB::Aggregate{500, 10, 2};
+        REQUIRE(loaded->setChildrenForPaths(updates));
+        REQUIRE(loaded->findEntry(path)->getSize() == 510);
+        REQUIRE(loaded->getFileCount() == 11);
+        REQUIRE(loaded->getDirCount() == 4);
+    }
+
+    SECTION("Aggregate is removed with directory")
+    {
+        entries.push_back(FileEntry::create("file1", false, 10));
+        REQUIRE(db.setChildrenForPath(path, std::move(entries)));
+        REQUIRE_FALSE(db.getAggregate(dirPath, aggregate));
+        REQUIRE(db.getFileCount() == 1);
+        REQUIRE(db.getDirCount() == 1);
+    }
+}
+
+TEST_CASE("FileDB snapshots", "[filedb]")
+{
+    const std::string snapshotPath = "TestSnapshot.bin";
+    FilePath path("/home/");
+    FileDB db(path.getRoot());
+    createSampleDb(db);
+
+    REQUIRE(db.saveSnapshot(snapshotPath));
+
+    SECTION("Snapshot restores the same tree")
+    {
+        auto loaded = FileDB::loadSnapshot(snapshotPath);
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getRootPath().getPath() == db.getRootPath().getPath());
+        REQUIRE(loaded->getFileCount() == 9);
+        REQUIRE(loaded->getDirCount() == 4);
+
+        int64_t used, available, total;
+        loaded->getSpace(used, available, total);
+        REQUIRE(total == 500);
+        REQUIRE(available == 100);
+        REQUIRE(used == 210);
+
+        path.addDir("dir2");
+        auto dir2 = loaded->findEntry(path);
+        REQUIRE(dir2 != nullptr);
+        REQUIRE(dir2->getSize() == 75);
+        std::vector<std::string> names;
+        dir2->forEach([&names](const FileEntry &entry) -> bool {
+            names.emplace_back(entry.getName());
+            return true;
+        });
+        REQUIRE(names == std::vector<std::string>{"file5", "file6", "file4"});
+
+        // loaded db can be changed as usual
+        std::vector<std::unique_ptr<FileEntry>> entries;
+        entries.push_back(FileEntry::create("file4", false, 100));
+        REQUIRE(loaded->setChildrenForPath(path, std::move(entries)));
+        REQUIRE(loaded->getFileCount() == 7);
+        REQUIRE(dir2->getSize() == 100);
+    }
+
+    SECTION("Invalid snapshots are not loaded")
+    {
+        REQUIRE(FileDB::loadSnapshot("TestSnapshotMissing.bin") == nullptr);
+
+        // truncated snapshot
+        {
+            std::ifstream in(snapshotPath, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            in.close();
+            std::ofstream out(snapshotPath, std::ios::binary | std::ios::trunc);
+            out.write(content.data(), std::streamsize(content.size() - 1));
+        }
+        REQUIRE(FileDB::loadSnapshot(snapshotPath) == nullptr);
+    }
+
+    SECTION("Size mode is saved to snapshot")
+    {
+        FileDB onDiskDb(path.getRoot(), SizeMode::ON_DISK);
+        createSampleDb(onDiskDb);
+        REQUIRE(onDiskDb.saveSnapshot(snapshotPath));
+
+        auto loaded = FileDB::loadSnapshot(snapshotPath);
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getSizeMode() == SizeMode::ON_DISK);
+        REQUIRE(db.getSizeMode() == SizeMode::APPARENT);
+    }
+
+    std::remove(snapshotPath.c_str());
+}
+
+TEST_CASE("FileDB memory budget", "[filedb]")
+{
+    const std::string spillPath = "TestSpill.bin";
+    FilePath rootPath("/home/");
+    FileDB db(rootPath.getRoot());
+    int64_t entryMemory = db.getMemoryUsage();
+    REQUIRE(entryMemory > 0);
+
+    // the whole tree takes 411 entries, but only 200 fit in budget
+    REQUIRE(db.setMemoryBudget(200 * entryMemory, spillPath));
+
+    std::vector<std::unique_ptr<FileEntry>> entries;
+    entries.push_back(FileEntry::create("top1", true));
+    entries.push_back(FileEntry::create("top2", true));
+    REQUIRE(db.setChildrenForPath(rootPath, std::move(entries)));
+    for (int i = 1; i <= 2; ++i) {
+        FilePath top(rootPath);
+        top.addDir("top" + std::to_string(i));
+        for (int j = 1; j <= 4; ++j)
+            entries.push_back(FileEntry::create("sub" + std::to_string(j), true));
+        REQUIRE(db.setChildrenForPath(top, std::move(entries)));
+        for (int j = 1; j <= 4; ++j) {
+            FilePath sub(top);
+            sub.addDir("sub" + std::to_string(j));
+            for (int k = 1; k <= 50; ++k)
+                entries.push_back(FileEntry::create("file" + std::to_string(k), false, k));
+            REQUIRE(db.setChildrenForPath(sub, std::move(entries)));
+        }
+    }
+
+    REQUIRE(db.getFileCount() == 400);
+    REQUIRE(db.getDirCount() == 11);
+    REQUIRE(db.getSpilledCount() > 0);
+    REQUIRE(db.getMemoryUsage() <= 200 * entryMemory);
+    REQUIRE(db.findEntry(rootPath)->getSize() == 8 * 1275);
+
+    SECTION("Spilled subtree is loaded when accessed")
+    {
+        FilePath path(rootPath);
+        path.addDir("top2");
+        path.addDir("sub4");
+        std::vector<std::string> names;
+        REQUIRE(db.processEntry(path, [&names](const FileEntry &entry) {
+            REQUIRE(entry.getSize() == 1275);
+            entry.forEach([&names](const FileEntry &child) -> bool {
+                names.emplace_back(child.getName());
+                return true;
+            });
+        }));
+        REQUIRE(names.size() == 50);
+        REQUIRE(names.front() == "file50");
+
+        path.addFile("file7");
+        auto file = db.findEntry(path);
+        REQUIRE(file != nullptr);
+        REQUIRE(file->getSize() == 7);
+    }
+
+    SECTION("Spilled subtree can be changed")
+    {
+        FilePath path(rootPath);
+        path.addDir("top1");
+        path.addDir("sub1");
+        entries.push_back(FileEntry::create("file1", false, 1000));
+        REQUIRE(db.setChildrenForPath(path, std::move(entries)));
+        REQUIRE(db.getFileCount() == 351);
+        REQUIRE(db.findEntry(rootPath)->getSize() == 7 * 1275 + 1000);
+
+        // spilled subtree is deleted together with its parent
+        path.goUp();
+        entries.push_back(FileEntry::create("sub1", true));
+        REQUIRE(db.setChildrenForPath(path, std::move(entries)));
+        REQUIRE(db.getFileCount() == 201);
+        REQUIRE(db.getDirCount() == 8);
+    }
+
+    SECTION("Spilled subtrees are saved to snapshot")
+    {
+        const std::string snapshotPath = "TestSnapshot.bin";
+        REQUIRE(db.saveSnapshot(snapshotPath));
+        auto loaded = FileDB::loadSnapshot(snapshotPath);
+        std::remove(snapshotPath.c_str());
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getFileCount() == 400);
+        REQUIRE(loaded->getDirCount() == 11);
+        REQUIRE(loaded->getSpilledCount() == 0);
+
+        FilePath path(rootPath);
+        path.addDir("top1");
+        path.addDir("sub2");
+        path.addFile("file50");
+        auto file = loaded->findEntry(path);
+        REQUIRE(file != nullptr);
+        REQUIRE(file->getSize() == 50);
+
+        // budget can be set when tree is already built
+        REQUIRE(loaded->setMemoryBudget(200 * entryMemory, "TestSpillLoaded.bin"));
+        path.goUp();
+        for (int k = 1; k <= 50; ++k)
+            entries.push_back(FileEntry::create("file" + std::to_string(k), false, k));
+        REQUIRE(loaded->setChildrenForPath(path, std::move(entries)));
+        REQUIRE(loaded->getSpilledCount() > 0);
+        REQUIRE(loaded->getMemoryUsage() <= 200 * entryMemory);
+    }
+}
+
+TEST_CASE("FileDB directory stamps", "[filedb]")
+{
+    FilePath path("/home/");
+    FileDB db(path.getRoot());
+    createSampleDb(db);
+
+    PlatformUtils::DirStamp stamp{100, 200, 5, 7};
+    std::vector<std::unique_ptr<FilePath>> childDirs;
+
+    // stamp is not known yet
+    REQUIRE_FALSE(db.getChildDirsIfUnchanged(path, stamp, childDirs));
+
+    std::vector<FileDB::ChildrenUpdate> updates;
+    std::vector<std::unique_ptr<FileEntry>> entries;
+    entries.push_back(FileEntry::create("dir1", true));
+    entries.push_back(FileEntry::create("dir2", true));
+    entries.push_back(FileEntry::create("file", false, 10));
+    updates.emplace_back(Utils::make_unique<FilePath>(path), std::move(entries), false);
+    updates[0].hasStamp = true;
+    updates[0].stamp = stamp;
+    REQUIRE(db.setChildrenForPaths(updates));
+
+    SECTION("Unchanged directory returns its child dirs")
+    {
+        REQUIRE(db.getChildDirsIfUnchanged(path, stamp, childDirs));
+        REQUIRE(childDirs.size() == 2);
+        // dirs are in the same order as children (dir2 is bigger)
+        REQUIRE(childDirs[0]->getName() == "dir2");
+        REQUIRE(childDirs[1]->getName() == "dir1");
+    }
+
+    SECTION("Changed directory is reported")
+    {
+        auto changed = stamp;
+        changed.modifyTime += 1;
+        REQUIRE_FALSE(db.getChildDirsIfUnchanged(path, changed, childDirs));
+        changed = stamp;
+        changed.inode += 1;
+        REQUIRE_FALSE(db.getChildDirsIfUnchanged(path, changed, childDirs));
+        REQUIRE(childDirs.empty());
+    }
+
+    SECTION("Setting children without stamp removes it")
+    {
+        entries.push_back(FileEntry::create("dir1", true));
+        REQUIRE(db.setChildrenForPath(path, std::move(entries)));
+        REQUIRE_FALSE(db.getChildDirsIfUnchanged(path, stamp, childDirs));
+    }
+
+    SECTION("Stamps are saved to snapshot")
+    {
+        const std::string snapshotPath = "TestSnapshot.bin";
+        REQUIRE(db.saveSnapshot(snapshotPath));
+        auto loaded = FileDB::loadSnapshot(snapshotPath);
+        std::remove(snapshotPath.c_str());
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->getChildDirsIfUnchanged(path, stamp, childDirs));
+        REQUIRE(childDirs.size() == 2);
+    }
+}
@@ -0,0 +1,79 @@
+#include "FileEntryIndex.h"
+#include "fileentry.h"
+#include "utils.h"
+
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("FileEntryIndex lookups", "[file-entry-index]")
+{
+    FileEntryIndex index;
+    FileEntry root("/root/", true);
+
+    std::vector<FileEntry *> dirs;
+    for (int i = 0; i < 20; ++i) {
+        auto dir = FileEntry::create(Utils::strFormat("dir%d", i), true);
+        dirs.push_back(dir.get());
+        root.addChild(std::move(dir));
+        index.insert(dirs.back());
+    }
+    // all dirs have children with the same names
+    std::vector<FileEntry *> files;
+    for (auto dir : dirs) {
+        for (int i = 0; i < 500; ++i) {
+            auto file = FileEntry::create(Utils::strFormat("file%d", i), false, i);
+            files.push_back(file.get());
+            dir->addChild(std::move(file));
+            index.insert(files.back());
+        }
+    }
+    REQUIRE(index.size() == dirs.size() + files.size());
+
+    SECTION("Entries are found by parent and name")
+    {
+        bool allFound = true;
+        for (auto file : files)
+            allFound &= index.find(file->getParent(), file->getName(), strlen(file->getName())) == file;
+        REQUIRE(allFound);
+        REQUIRE(index.find(&root, "dir5", 4) == dirs[5]);
+        REQUIRE(index.find(dirs[3], "file42", 6) == files[3 * 500 + 42]);
+    }
+
+    SECTION("Name doesn't have to be null-terminated")
+    {
+        REQUIRE(index.find(&root, "dir5/", 4) == dirs[5]);
+        REQUIRE(index.find(&root, "dir5/", 5) == nullptr);
+    }
+
+    SECTION("Missing entries are not found")
+    {
+        REQUIRE(index.find(&root, "file1", 5) == nullptr);
+        REQUIRE(index.find(dirs[0], "dir1", 4) == nullptr);
+        REQUIRE(index.find(dirs[0], "file", 4) == nullptr);
+        REQUIRE(index.find(dirs[0], "file5000", 8) == nullptr);
+        REQUIRE(index.find(nullptr, "dir1", 4) == nullptr);
+    }
+
+    SECTION("Removed entries are not found, others are still found")
+    {
+        for (size_t i = 0; i < files.size(); i += 2)
+            REQUIRE(index.remove(files[i]));
+        REQUIRE_FALSE(index.remove(files[0]));
+        REQUIRE(index.size() == dirs.size() + files.size() / 2);
+
+        bool isCorrect = true;
+        for (size_t i = 0; i < files.size(); ++i) {
+            auto file = files[i];
+            auto found = index.find(file->getParent(), file->getName(), strlen(file->getName()));
+            isCorrect &= found == (i % 2 == 0 ? nullptr : file);
+        }
+        REQUIRE(isCorrect);
+
+        // removed entries can be added back
+        for (size_t i = 0; i < files.size(); i += 2)
+            index.insert(files[i]);
+        REQUIRE(index.size() == dirs.size() + files.size());
+        REQUIRE(index.find(dirs[0], "file0", 5) == files[0]);
+    }
+}
@@ -25,7 +25,7 @@ TEST_CASE("FileEntry construction", "[fileentry]")
         REQUIRE(entry.isDir());
         REQUIRE(entry.isRoot());
         REQUIRE(entry.getParent() == nullptr);
-        REQUIRE(entry.getNameCrc() == entry.getPathCrc());
+        REQUIRE(entry.getNameCrc() == Utils::strCrc16("TestEntry"));
     }
 }
 
@@ -40,7 +40,7 @@ TEST_CASE("FileEntry simple tree construction", "[fileentry]")
     FileEntry *lastChild;
     for (int i = 0; i < 100; ++i) {
         auto childName = Utils::strFormat("Child%d", i);
-        auto child = Utils::make_unique<FileEntry>(childName, false, i * 10);
+        auto child = FileEntry::create(childName, false, i * 10);
         totalSize += child->getSize();
         lastChild = child.get();
         root.addChild(std::move(child));
@@ -63,7 +63,7 @@ TEST_CASE("FileEntry simple tree construction", "[fileentry]")
     INFO("Add new children");
     for (int i = 0; i < 200; ++i) {
         auto childName = Utils::strFormat("Child%d", i + 100);
-        auto child = Utils::make_unique<FileEntry>(childName, false, i * 5);
+        auto child = FileEntry::create(childName, false, i * 5);
         totalSize += child->getSize();
         lastChild = child.get();
         root.addChild(std::move(child));
@@ -104,7 +104,7 @@ TEST_CASE("FileEntry simple tree construction", "[fileentry]")
             REQUIRE(dirs == 0);
             std::vector<std::unique_ptr<FileEntry>> deleted;
             root.removePendingDelete(deleted);
-            REQUIRE(deleted.size() == files);
+            REQUIRE(deleted.size() == size_t(files));
             REQUIRE(root.getSize() == 0);
         }
 
@@ -180,7 +180,7 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
     std::vector<FileEntry *> children;
     for (int i = 0; i < 5; ++i) {
         auto childName = Utils::strFormat("Child_%d", i);
-        auto child = Utils::make_unique<FileEntry>(childName, true);
+        auto child = FileEntry::create(childName, true);
         totalSize += child->getSize();
         auto lastChild = child.get();
         root.addChild(std::move(child));
@@ -196,7 +196,7 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
     for (auto &child : children) {
         for (int i = 0; i < 5; ++i) {
             auto childName = Utils::strFormat("Child_%d", i);
-            auto newChild = Utils::make_unique<FileEntry>(childName, true, intDistr(randEngine));
+            auto newChild = FileEntry::create(childName, true, intDistr(randEngine));
             totalSize += newChild->getSize();
             auto lastChild = newChild.get();
             child->addChild(std::move(newChild));
@@ -222,8 +222,8 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
         return true;
     });
     //reverse initial order
-    for (int i = 0; i < children.size(); ++i)
-        children[i]->setSize(children[i]->getSize() + 10 * i);
+    for (size_t i = 0; i < children.size(); ++i)
+        children[i]->setSize(children[i]->getSize() + 10 * int64_t(i));
 
     INFO("Check that children are sorted");
     prevEntry = nullptr;
@@ -235,8 +235,8 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
         return true;
     });
     //restore order
-    for (int i = 0; i < children.size(); ++i)
-        children[i]->setSize(children[i]->getSize() - 10 * i);
+    for (size_t i = 0; i < children.size(); ++i)
+        children[i]->setSize(children[i]->getSize() - 10 * int64_t(i));
     INFO("Check that children are sorted");
     prevEntry = nullptr;
     root.forEach([&prevEntry](const FileEntry &child) -> bool {
@@ -259,7 +259,7 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
     REQUIRE(subdir->getSize() > 0);
     std::vector<std::unique_ptr<FileEntry>> deleted;
     subdir->removePendingDelete(deleted);
-    REQUIRE(dirs == deleted.size());
+    REQUIRE(size_t(dirs) == deleted.size());
     REQUIRE(subdir->getSize() == 0);
 
     INFO("Check that children are sorted");
@@ -272,3 +272,84 @@ TEST_CASE("FileEntry deep tree construction", "[fileentry]")
         return true;
     });
 }
+
+TEST_CASE("FileEntry children stay sorted after size changes", "[fileentry]")
+{
+    FileEntry root("/root/", true);
+    std::vector<FileEntry *> children;
+
+    std::default_random_engine randEngine(42);
+    std::uniform_int_distribution<int> sizeDistr(0, 20);
+    int64_t totalSize = 0;
+    for (int i = 0; i < 500; ++i) {
+        auto child = FileEntry::create(Utils::strFormat("Child%d", i), false, sizeDistr(randEngine));
+        totalSize += child->getSize();
+        children.push_back(child.get());
+        root.addChild(std::move(child));
+    }
+
+    std::uniform_int_distribution<size_t> childDistr(0, children.size() - 1);
+    for (int i = 0; i < 2000; ++i) {
+        auto child = children[childDistr(randEngine)];
+        auto newSize = sizeDistr(randEngine);
+        totalSize += newSize - child->getSize();
+        child->setSize(newSize);
+    }
+    REQUIRE(root.getSize() == totalSize);
+
+    size_t count = 0;
+    bool isSorted = true;
+    int64_t prevSize = INT64_MAX;
+    root.forEach([&count, &isSorted, &prevSize](const FileEntry &child) -> bool {
+        isSorted &= child.getSize() <= prevSize;
+        prevSize = child.getSize();
+        ++count;
+        return true;
+    });
+    REQUIRE(count == children.size());
+    REQUIRE(isSorted);
+}
+
+TEST_CASE("FileEntry batch update of children", "[fileentry]")
+{
+    FileEntry root("/root/", true);
+    auto dir = FileEntry::create("dir", true);
+    auto dirPtr = dir.get();
+    root.addChild(std::move(dir));
+    root.addChild(FileEntry::create("file", false, 50));
+
+    std::vector<FileEntry *> children;
+    auto sizeBefore = dirPtr->beginChildrenUpdate();
+    for (int i = 0; i < 100; ++i) {
+        auto child = FileEntry::create(Utils::strFormat("Child%d", i), false, i);
+        children.push_back(child.get());
+        dirPtr->addChild(std::move(child));
+    }
+    children[0]->setSize(200);
+
+    // size of dir is updated, but its parent is not changed until update is finished
+    REQUIRE(dirPtr->getSize() == 5150);
+    REQUIRE(root.getSize() == 50);
+
+    dirPtr->endChildrenUpdate(sizeBefore);
+    REQUIRE(root.getSize() == 5200);
+
+    std::vector<const FileEntry *> order;
+    root.forEach([&order](const FileEntry &child) -> bool {
+        order.push_back(&child);
+        return true;
+    });
+    // dir became bigger than file, so it is moved before it
+    REQUIRE(order.size() == 2);
+    REQUIRE(order[0] == dirPtr);
+
+    bool isSorted = true;
+    int64_t prevSize = INT64_MAX;
+    dirPtr->forEach([&isSorted, &prevSize](const FileEntry &child) -> bool {
+        isSorted &= child.getSize() <= prevSize;
+        prevSize = child.getSize();
+        return true;
+    });
+    REQUIRE(isSorted);
+    REQUIRE(dirPtr->getChildCount() == 100);
+}
@@ -3,6 +3,9 @@
 #include "DirHelper.h"
 
 #include <sstream>
+#include <fstream>
+#include <map>
+#include <tuple>
 
 struct File {
     std::string name;
@@ -77,4 +80,56 @@ TEST_CASE("FileIterator tests", "[file]")
 
         REQUIRE_THAT(files, Catch::Matchers::UnorderedEquals(expectedFiles));
     }
+
+    SECTION("Iterator reports file sizes")
+    {
+        dh.createDir("dir");
+        FilePath path("TestDir");
+        path.addFile("file.txt");
+        std::ofstream fs(path.getPath());
+        fs << std::string(1000, 'a');
+        fs.close();
+
+        std::vector<File> files;
+        for (auto it = FileIterator::create("TestDir"); it->isValid(); ++(*it))
+            files.emplace_back(*it);
+
+        REQUIRE(files.size() == 2);
+        for (auto &f : files) {
+            if (f.isDir)
+                REQUIRE(f.size == 0);
+            else
+                REQUIRE(f.size == 1000);
+        }
+    }
+
+    SECTION("Async and sequential stat give the same results")
+    {
+        dh.createDir("dir");
+        // enough files so they are stat'ed in one batch
+        for (int i = 0; i < 20; ++i)
+            dh.createFile("file" + std::to_string(i) + ".txt", size_t(i * 100));
+        dh.createHardLink("file5.txt", "link.txt");
+
+        typedef std::tuple<bool, int64_t, int64_t, bool, uint64_t, uint64_t> Stat;
+        auto statAll = []() {
+            std::map<std::string, Stat> stats;
+            for (auto it = FileIterator::create("TestDir"); it->isValid(); ++(*it)) {
+                uint64_t device = 0, inode = 0;
+                bool isLink = it->getHardLinkId(device, inode);
+                stats[it->getName()] = Stat(it->isDir(), it->getSize(), it->getAllocatedSize(),
+                                            isLink, device, inode);
+            }
+            return stats;
+        };
+
+        FileIterator::setAsyncStatEnabled(false);
+        auto sequential = statAll();
+        FileIterator::setAsyncStatEnabled(true);
+        auto async = statAll();
+
+        REQUIRE(sequential.size() == 22);
+        REQUIRE(std::get<1>(sequential["file7.txt"]) == 700);
+        REQUIRE(sequential == async);
+    }
 }
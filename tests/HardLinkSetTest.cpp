@@ -0,0 +1,120 @@
+#include "HardLinkSet.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+TEST_CASE("HardLinkSet", "[hardlinks]")
+{
+    HardLinkSet links;
+
+    SECTION("Only owner link is counted")
+    {
+        REQUIRE(links.claim(1, 100, 10));
+        REQUIRE_FALSE(links.claim(1, 100, 20));
+        // the same link is counted again when it is scanned again
+        REQUIRE(links.claim(1, 100, 10));
+        REQUIRE(links.size() == 1);
+    }
+
+    SECTION("Released file is claimed by another link")
+    {
+        std::vector<std::string> linkDirs;
+        REQUIRE(links.claim(1, 100, 10));
+        REQUIRE(links.claim(1, 200, 10));
+        REQUIRE_FALSE(links.claim(1, 100, 20, "dir2/"));
+        links.release(20, linkDirs);
+        REQUIRE(linkDirs.empty());
+        REQUIRE(links.size() == 2);
+
+        links.release(10, linkDirs);
+        REQUIRE(links.size() == 0);
+        REQUIRE(links.empty());
+        // only directory of link that wasn't counted should be scanned again
+        REQUIRE(linkDirs.size() == 1);
+        REQUIRE(linkDirs[0] == "dir2/");
+        REQUIRE(links.claim(1, 100, 20));
+        REQUIRE_FALSE(links.claim(1, 100, 10));
+    }
+
+    SECTION("Release keeps other files reachable")
+    {
+        std::vector<std::string> linkDirs;
+        // files with even inodes are owned by link 1, so removed slots are spread between others
+        for (uint64_t i = 0; i < 10000; ++i)
+            links.claim(1, i, i % 2 == 0 ? 1 : 2);
+        links.release(1, linkDirs);
+        REQUIRE(links.size() == 5000);
+        bool allFound = true;
+        for (uint64_t i = 1; i < 10000; i += 2)
+            allFound = allFound && links.claim(1, i, 2) && !links.claim(1, i, 3);
+        REQUIRE(allFound);
+    }
+
+    SECTION("Files on different devices are different")
+    {
+        REQUIRE(links.claim(1, 100, 10));
+        REQUIRE(links.claim(2, 100, 20));
+        REQUIRE(links.size() == 2);
+    }
+
+    SECTION("Clear forgets all files")
+    {
+        REQUIRE(links.claim(1, 100, 10));
+        links.clear();
+        REQUIRE(links.size() == 0);
+        REQUIRE(links.claim(1, 100, 20));
+        REQUIRE_FALSE(links.claim(1, 100, 10));
+    }
+
+    SECTION("Many files")
+    {
+        for (uint64_t i = 0; i < 100000; ++i)
+            links.claim(1, i, 1);
+        REQUIRE(links.size() == 100000);
+        bool allFound = true;
+        for (uint64_t i = 0; i < 100000; ++i)
+            allFound = allFound && !links.claim(1, i, 2);
+        REQUIRE(allFound);
+    }
+
+    SECTION("Concurrent claims count each file once")
+    {
+        const int threadCount = 4;
+        std::vector<int> claimed(threadCount, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&links, &claimed, t]() {
+                for (uint64_t i = 0; i < 10000; ++i) {
+                    if (links.claim(1, i, static_cast<uint32_t>(t)))
+                        ++claimed[t];
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        int total = 0;
+        for (auto count : claimed)
+            total += count;
+        REQUIRE(total == 10000);
+    }
+}
+
+TEST_CASE("HardLinkSet is bounded", "[hardlinks]")
+{
+    HardLinkSet links(640);
+
+    for (uint64_t i = 0; i < 10000; ++i)
+        links.claim(1, i, 1);
+    REQUIRE(links.size() <= 640);
+
+    // files that don't fit are counted for every link
+    int counted = 0;
+    for (uint64_t i = 0; i < 10000; ++i) {
+        if (links.claim(1, i, 2))
+            ++counted;
+    }
+    REQUIRE(counted == 10000 - static_cast<int>(links.size()));
+}
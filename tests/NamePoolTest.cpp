@@ -0,0 +1,76 @@
+#include "NamePool.h"
+#include "fileentry.h"
+#include "utils.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+TEST_CASE("NamePool", "[namepool]")
+{
+    auto countBefore = NamePool::getNameCount();
+
+    SECTION("Equal names share id")
+    {
+        auto id1 = NamePool::acquire("pool_test_name", 14);
+        // name doesn't have to be null-terminated
+        auto id2 = NamePool::acquire("pool_test_name_other", 14);
+        auto id3 = NamePool::acquire("pool_test_other", 15);
+        REQUIRE(id1 != NamePool::invalidId);
+        REQUIRE(id1 == id2);
+        REQUIRE(id1 != id3);
+        REQUIRE(NamePool::getNameCount() == countBefore + 2);
+
+        REQUIRE(strcmp(NamePool::getName(id1), "pool_test_name") == 0);
+        REQUIRE(NamePool::getLength(id1) == 14);
+        REQUIRE(NamePool::find("pool_test_other", 15) == id3);
+
+        NamePool::release(id1);
+        NamePool::release(id3);
+        // name is still referenced once
+        REQUIRE(NamePool::find("pool_test_name", 14) == id1);
+        REQUIRE(NamePool::find("pool_test_other", 15) == NamePool::invalidId);
+        NamePool::release(id2);
+        REQUIRE(NamePool::find("pool_test_name", 14) == NamePool::invalidId);
+        REQUIRE(NamePool::getNameCount() == countBefore);
+    }
+
+    SECTION("Entries with the same name reference the same string")
+    {
+        FileEntry entry1("pool_test_entry", false);
+        FileEntry entry2("pool_test_entry", true);
+        REQUIRE(entry1.getNameId() == entry2.getNameId());
+        REQUIRE(entry1.getName() == entry2.getName());
+        REQUIRE(NamePool::getNameCount() == countBefore + 1);
+    }
+
+    SECTION("Names can be added from many threads")
+    {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<uint32_t>> ids(4);
+        for (size_t t = 0; t < ids.size(); ++t) {
+            threads.emplace_back([&ids, t]() {
+                for (int i = 0; i < 10000; ++i) {
+                    auto name = Utils::strFormat("pool_test_%d", i);
+                    ids[t].push_back(NamePool::acquire(name.c_str(), name.size()));
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        REQUIRE(NamePool::getNameCount() == countBefore + 10000);
+        bool sameIds = true;
+        for (size_t t = 1; t < ids.size(); ++t)
+            sameIds = sameIds && ids[t] == ids[0];
+        REQUIRE(sameIds);
+
+        for (auto &threadIds : ids) {
+            for (auto id : threadIds)
+                NamePool::release(id);
+        }
+        REQUIRE(NamePool::getNameCount() == countBefore);
+    }
+}
@@ -0,0 +1,104 @@
+#include "ScanQueue.h"
+#include "filepath.h"
+#include "utils.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+static std::unique_ptr<FilePath> makePath(const std::string &path) {
+    // all paths are directories with the same root
+    return Utils::make_unique<FilePath>(path + "/", "/");
+}
+
+static std::vector<std::string> popAll(ScanQueue &queue) {
+    std::vector<std::string> paths;
+    ScanQueue::Request request;
+    while (queue.pop(request))
+        paths.push_back(request.path->getPath());
+    return paths;
+}
+
+TEST_CASE("Scan queue order", "[scan-queue]")
+{
+    ScanQueue queue;
+    REQUIRE(queue.empty());
+
+    queue.push(makePath("/a/b"), false, false);
+    queue.push(makePath("/c"), false, false);
+    queue.push(makePath("/d"), false, false, false);
+    REQUIRE(queue.size() == 3);
+
+    SECTION("Requests are taken from front")
+    {
+        REQUIRE(popAll(queue) == std::vector<std::string>{"/d/", "/a/b/", "/c/"});
+        REQUIRE(queue.empty());
+    }
+
+    SECTION("Duplicate is moved to new place")
+    {
+        queue.push(makePath("/a/b"), false, false);
+        REQUIRE(queue.size() == 3);
+        REQUIRE(popAll(queue) == std::vector<std::string>{"/d/", "/c/", "/a/b/"});
+    }
+
+    SECTION("Clear removes everything")
+    {
+        queue.clear();
+        REQUIRE(queue.empty());
+        ScanQueue::Request request;
+        REQUIRE_FALSE(queue.pop(request));
+        queue.push(makePath("/a/b"), false, false);
+        REQUIRE(queue.size() == 1);
+    }
+}
+
+TEST_CASE("Scan queue merging", "[scan-queue]")
+{
+    ScanQueue queue;
+
+    SECTION("Recursive request replaces requests inside it")
+    {
+        queue.push(makePath("/a/b/c"), false, false);
+        queue.push(makePath("/a/d"), true, false);
+        queue.push(makePath("/e"), false, false);
+        queue.push(makePath("/a"), true, false);
+        REQUIRE(popAll(queue) == std::vector<std::string>{"/e/", "/a/"});
+    }
+
+    SECTION("Non recursive request doesn't replace requests inside it")
+    {
+        queue.push(makePath("/a/b"), false, false);
+        queue.push(makePath("/a"), false, false);
+        REQUIRE(queue.size() == 2);
+    }
+
+    SECTION("Request inside queued recursive request is not added")
+    {
+        queue.push(makePath("/a"), true, false);
+        queue.push(makePath("/a/b/c"), false, false);
+        queue.push(makePath("/a/d"), true, true);
+        REQUIRE(queue.size() == 1);
+    }
+
+    SECTION("Quick request doesn't replace full requests")
+    {
+        queue.push(makePath("/a/b"), false, false);
+        queue.push(makePath("/a/c"), true, true);
+        queue.push(makePath("/a"), true, true);
+        REQUIRE(popAll(queue) == std::vector<std::string>{"/a/b/", "/a/"});
+
+        queue.push(makePath("/a"), true, true);
+        queue.push(makePath("/a/b"), false, false);
+        REQUIRE(queue.size() == 2);
+    }
+
+    SECTION("Requests for the same path are merged")
+    {
+        queue.push(makePath("/a"), true, false);
+        queue.push(makePath("/a"), false, true);
+        ScanQueue::Request request;
+        REQUIRE(queue.pop(request));
+        REQUIRE(request.recursive);
+        REQUIRE_FALSE(request.quick);
+        REQUIRE(queue.empty());
+    }
+}
@@ -1,13 +1,17 @@
 #include "spacescanner.h"
 #include "filepath.h"
 #include "filedb.h"
+#include "fileentry.h"
 #include "utils.h"
 #include "platformutils.h"
 #include "DirHelper.h"
 
 #include <iostream>
+#include <cstdio>
+#include <fstream>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 
 TEST_CASE("Scanner tests", "[scanner]")
 {
@@ -152,7 +156,7 @@ TEST_CASE("Scanner tests", "[scanner]")
             REQUIRE(scanner->hasChanges());
             auto &db = scanner->getFileDB();
             auto root = scanner->getRootPath();
-            auto processed = db.processEntry(root, [](const FileEntry &entry) {});
+            auto processed = db.processEntry(root, [](const FileEntry &) {});
             REQUIRE(processed);
             REQUIRE_FALSE(scanner->hasChanges());
 
@@ -178,3 +182,262 @@ TEST_CASE("Scanner tests", "[scanner]")
         }
     }
 }
+
+TEST_CASE("Parallel scan", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    for (int i = 0; i < 10; ++i) {
+        auto dir = Utils::strFormat("dir%d", i);
+        dh.createDir(dir);
+        dh.createFile(dir + "/test.txt");
+        for (int j = 0; j < 5; ++j) {
+            auto subDir = Utils::strFormat("%s/sub%d", dir.c_str(), j);
+            dh.createDir(subDir);
+            dh.createFile(subDir + "/test1.txt");
+            dh.createFile(subDir + "/test2.txt");
+        }
+    }
+
+    auto threadCount = GENERATE(1u, 2u, 8u);
+    INFO("Threads: " << threadCount);
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir", threadCount);
+
+    //wait for scanner to complete
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(scanner->getDirCount() == 61);
+    REQUIRE(scanner->getFileCount() == 110);
+    REQUIRE(scanner->getCurrentScanPath() == nullptr);
+}
+
+TEST_CASE("Scan from snapshot", "[scanner]")
+{
+    const std::string snapshotPath = "TestScanSnapshot.bin";
+    DirHelper dh("TestDir");
+    dh.createDir("test");
+    dh.createFile("test/test.txt");
+    dh.createFile("test/test2.txt");
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    REQUIRE_FALSE(scanner->isLoadedFromSnapshot());
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->saveSnapshot(snapshotPath));
+    scanner.reset();
+
+    // changes made while app was closed are found by verification scan
+    dh.createDir("test2");
+    dh.createFile("test2/test.txt");
+
+    scanner = Utils::make_unique<SpaceScanner>("TestDir", 0, snapshotPath);
+    REQUIRE(scanner->isLoadedFromSnapshot());
+    REQUIRE(scanner->getDirCount() >= 2);
+    REQUIRE(scanner->getFileCount() >= 2);
+
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->getDirCount() == 3);
+    REQUIRE(scanner->getFileCount() == 3);
+
+    // snapshot of another path is ignored
+    scanner = Utils::make_unique<SpaceScanner>("TestDir/test", 0, snapshotPath);
+    REQUIRE_FALSE(scanner->isLoadedFromSnapshot());
+
+    scanner.reset();
+    std::remove(snapshotPath.c_str());
+}
+
+TEST_CASE("Quick rescan", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    for (int i = 0; i < 5; ++i) {
+        auto dir = Utils::strFormat("dir%d", i);
+        dh.createDir(dir);
+        dh.createFile(dir + "/test.txt");
+        dh.createDir(dir + "/sub");
+        dh.createFile(dir + "/sub/test.txt");
+    }
+    // stamps of just modified directories are not trusted, so wait until they become stable
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->getDirCount() == 11);
+    REQUIRE(scanner->getFileCount() == 10);
+
+    scanner->rescanPath(FilePath("TestDir"), true);
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->getDirCount() == 11);
+    REQUIRE(scanner->getFileCount() == 10);
+
+    // changes deep inside unchanged directories are still found
+    dh.createFile("dir3/sub/test2.txt");
+    dh.createDir("dir4/sub/sub2");
+    scanner->rescanPath(FilePath("TestDir"), true);
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->getDirCount() == 12);
+    REQUIRE(scanner->getFileCount() == 11);
+}
+
+TEST_CASE("Hard links are counted once", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    dh.createDir("dir2");
+    // files of root are found before any of subdirectories are scanned, so file.txt is owner
+    dh.createFile("file.txt", 1000);
+    dh.createFile("other.txt", 10);
+    // enough links so they are stat'ed in one batch
+    for (int i = 0; i < 10; ++i)
+        REQUIRE(dh.createHardLink("file.txt", Utils::strFormat("dir2/link%d.txt", i)));
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(scanner->getFileCount() == 12);
+    int64_t used, available, total;
+    scanner->getSpace(used, available, total);
+    REQUIRE(used == 1010);
+
+    // rescan keeps the same link as owner, so size is not lost or counted twice
+    FilePath dir2("TestDir");
+    dir2.addDir("dir2");
+    scanner->rescanPath(dir2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scanner->getSpace(used, available, total);
+    REQUIRE(used == 1010);
+
+    // when owner link is deleted, file is counted by one of remaining links
+    // quick rescan doesn't list dir2 again by itself, since it is not changed
+    REQUIRE(dh.deleteFile("file.txt"));
+    scanner->rescanPath(FilePath("TestDir"), true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    REQUIRE(scanner->getFileCount() == 11);
+    scanner->getSpace(used, available, total);
+    REQUIRE(used == 1010);
+}
+
+TEST_CASE("Scanner can count space on disk", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    dh.createFile("file.txt", 1000);
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir", 0, std::string(), SizeMode::ON_DISK);
+    REQUIRE(scanner->getSizeMode() == SizeMode::ON_DISK);
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(scanner->getFileCount() == 1);
+    int64_t used, available, total;
+    scanner->getSpace(used, available, total);
+#ifndef _WIN32
+    // space is allocated in whole blocks
+    REQUIRE(used % 512 == 0);
+#else
+    REQUIRE(used == 1000);
+#endif
+}
+
+TEST_CASE("Scanner can cross filesystems", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    dh.createDir("dir1");
+    dh.createFile("dir1/file.txt", 100);
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    REQUIRE(scanner->isOneFileSystem());
+    scanner->setOneFileSystem(false);
+    REQUIRE_FALSE(scanner->isOneFileSystem());
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // directories on the same filesystem are scanned in both modes
+    REQUIRE(scanner->getFileCount() == 1);
+    REQUIRE(scanner->getDirCount() == 2);
+}
+
+TEST_CASE("Scanner can limit memory", "[scanner]")
+{
+    const std::string spillPath = "TestSpill.bin";
+    DirHelper dh("TestDir");
+    for (int i = 1; i <= 3; ++i) {
+        auto dir = "dir" + std::to_string(i);
+        dh.createDir(dir);
+        for (int j = 1; j <= 4; ++j) {
+            auto subDir = dir + "/sub" + std::to_string(j);
+            dh.createDir(subDir);
+            for (int k = 1; k <= 30; ++k)
+                dh.createFile(subDir + "/file" + std::to_string(k), 10);
+        }
+    }
+    auto entryMemory = FileDB("TestDir").getMemoryUsage();
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    REQUIRE(scanner->setMemoryBudget(100 * entryMemory, spillPath));
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // spilled entries are still counted
+    REQUIRE(scanner->getFileCount() == 360);
+    REQUIRE(scanner->getDirCount() == 16);
+    auto &db = scanner->getFileDB();
+    REQUIRE(db.findEntry(db.getRootPath())->getSize() == 3600);
+
+    FilePath path(db.getRootPath());
+    path.addDir("dir2");
+    path.addDir("sub3");
+    path.addFile("file30");
+    REQUIRE(db.findEntry(path) != nullptr);
+
+    scanner.reset();
+    REQUIRE_FALSE(std::ifstream(spillPath).good());
+}
+
+TEST_CASE("Scanner can limit depth", "[scanner]")
+{
+    DirHelper dh("TestDir");
+    dh.createDir("dir1");
+    dh.createDir("dir1/sub1");
+    dh.createDir("dir1/sub1/sub2");
+    dh.createFile("dir1/file1.txt", 100);
+    dh.createFile("dir1/sub1/file2.txt", 200);
+    dh.createFile("dir1/sub1/sub2/file3.txt", 300);
+    dh.createFile("file4.txt", 400);
+
+    auto scanner = Utils::make_unique<SpaceScanner>("TestDir");
+    scanner->setMaxDepth(1);
+    REQUIRE(scanner->getMaxDepth() == 1);
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // limit might be set after directories were already scanned
+    scanner->rescanPath(scanner->getRootPath());
+    while (scanner->getScanProgress() < 100)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // everything deeper than limit is still counted
+    REQUIRE(scanner->getFileCount() == 4);
+    REQUIRE(scanner->getDirCount() == 4);
+
+    auto &db = scanner->getFileDB();
+    FilePath path(db.getRootPath());
+    path.addDir("dir1");
+    auto dir = db.findEntry(path);
+    REQUIRE(dir != nullptr);
+    REQUIRE(dir->getChildCount() == 0);
+    REQUIRE(dir->getSize() == 600);
+    REQUIRE(dir->getParent()->getSize() == 1000);
+
+    FileDB::Aggregate aggregate{};
+    REQUIRE(db.getAggregate(path, aggregate));
+    REQUIRE(aggregate.fileCount == 3);
+    REQUIRE(aggregate.dirCount == 2);
+}
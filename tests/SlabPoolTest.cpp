@@ -0,0 +1,71 @@
+#include "SlabPool.h"
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Slab pool allocations", "[slab-pool]")
+{
+    SECTION("Objects of different sizes don't overlap")
+    {
+        std::vector<std::pair<char *, size_t>> objects;
+        for (size_t i = 0; i < 5000; ++i) {
+            auto size = 1 + (i * 7) % (SlabPool::maxSlabObjectSize + 64);
+            auto ptr = static_cast<char *>(SlabPool::allocate(size));
+            REQUIRE(ptr != nullptr);
+            REQUIRE(reinterpret_cast<uintptr_t>(ptr) % 8 == 0);
+            memset(ptr, int(i % 256), size);
+            objects.emplace_back(ptr, size);
+        }
+
+        bool isIntact = true;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            auto ptr = objects[i].first;
+            for (size_t j = 0; j < objects[i].second; ++j)
+                isIntact &= uint8_t(ptr[j]) == i % 256;
+        }
+        REQUIRE(isIntact);
+
+        for (auto &obj : objects)
+            SlabPool::deallocate(obj.first, obj.second);
+    }
+
+    SECTION("Freed memory is reused")
+    {
+        auto first = SlabPool::allocate(24);
+        SlabPool::deallocate(first, 24);
+        auto second = SlabPool::allocate(24);
+        REQUIRE(first == second);
+        SlabPool::deallocate(second, 24);
+    }
+
+    SECTION("Empty slabs are released")
+    {
+        auto usedBefore = SlabPool::getUsedSize();
+        auto reservedBefore = SlabPool::getReservedSize();
+        std::vector<void *> objects;
+        for (int i = 0; i < 100000; ++i)
+            objects.push_back(SlabPool::allocate(40));
+
+        REQUIRE(SlabPool::getUsedSize() - usedBefore == 100000 * 40);
+        auto reserved = SlabPool::getReservedSize();
+        REQUIRE(reserved > reservedBefore);
+
+        for (auto ptr : objects)
+            SlabPool::deallocate(ptr, 40);
+        REQUIRE(SlabPool::getUsedSize() == usedBefore);
+        REQUIRE(SlabPool::getReservedSize() - reservedBefore < (reserved - reservedBefore) / 10);
+    }
+
+    SECTION("Allocator can be used with containers")
+    {
+        std::set<int, std::less<int>, SlabAllocator<int>> numbers;
+        for (int i = 0; i < 1000; ++i)
+            numbers.insert(i * 3);
+        REQUIRE(numbers.size() == 1000);
+        REQUIRE(*numbers.begin() == 0);
+        REQUIRE(*numbers.rbegin() == 2997);
+    }
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <condition_variable>
 
 #include "filepath.h"
 #include "spacewatcher.h"
@@ -146,3 +147,227 @@ TEST_CASE("SpaceWatcher basic events", "[watcher]")
     }
 }
 
+TEST_CASE("SpaceWatcher is stopped right after start", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+
+    // watcher thread should not use watcher before it is constructed or after it is destroyed
+    for (int i = 0; i < 20; ++i) {
+        auto watcher = SpaceWatcher::create(root.getPath());
+        REQUIRE(watcher != nullptr);
+    }
+}
+
+TEST_CASE("SpaceWatcher notifies listener", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+
+    // listener state should outlive watcher
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool notified = false;
+
+    auto watcher = SpaceWatcher::create(root.getPath());
+    watcher->setEventListener([&]() {
+        std::lock_guard<std::mutex> lock(mtx);
+        notified = true;
+        cv.notify_all();
+    });
+
+    dh.createFile("test.txt");
+
+    std::unique_lock<std::mutex> lock(mtx);
+    REQUIRE(cv.wait_for(lock, std::chrono::seconds(1), [&]() { return notified; }));
+    REQUIRE(watcher->popEvent() != nullptr);
+}
+
+TEST_CASE("SpaceWatcher merges repeated events", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+    dh.createFile("test.txt");
+
+    auto watcher = SpaceWatcher::create(root.getPath());
+    root.addFile("test.txt");
+    // each write is read by watcher separately, but consumer didn't see the first one yet
+    for (int i = 0; i < 3; ++i) {
+        std::ofstream fs(root.getPath(), std::ios::app);
+        fs << "test\n";
+        fs.close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    auto ev = watcher->popEvent();
+    REQUIRE(ev != nullptr);
+    REQUIRE(ev->action == SpaceWatcher::FileAction::MODIFIED);
+    REQUIRE(watcher->popEvent() == nullptr);
+}
+
+TEST_CASE("SpaceWatcher coalesces events", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+    dh.createDir("test");
+
+    auto watcher = SpaceWatcher::create(root.getPath());
+    watcher->setCoalescing(true, std::chrono::milliseconds(200));
+    root.addDir("test");
+    watcher->addDir(root.getPath());
+
+    for (int i = 0; i < 10; ++i)
+        dh.createFile("test/test" + std::to_string(i) + ".txt");
+    dh.createFile("test.txt");
+
+    //events are held in queue during debounce window
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    std::chrono::steady_clock::time_point eventTime;
+    REQUIRE(watcher->getNextEventTime(eventTime));
+    REQUIRE(watcher->popEvent() == nullptr);
+
+    std::this_thread::sleep_until(eventTime + std::chrono::milliseconds(20));
+
+    auto ev = watcher->popEvent();
+    REQUIRE(ev != nullptr);
+    REQUIRE(ev->parentpath == root.getPath());
+    REQUIRE(ev->filepath == root.getPath());
+    REQUIRE(ev->action == SpaceWatcher::FileAction::MODIFIED);
+
+    ev = watcher->popEvent();
+    REQUIRE(ev != nullptr);
+    root.goUp();
+    REQUIRE(ev->parentpath == root.getPath());
+    REQUIRE(watcher->popEvent() == nullptr);
+}
+
+namespace {
+    // watcher without OS backend, events are added manually
+    class ManualWatcher : public SpaceWatcher {
+    public:
+        int64_t getDirCountLimit() const override { return -1; }
+
+        using SpaceWatcher::addEvent;
+        using SpaceWatcher::reportLostEvents;
+
+    protected:
+        void readEvents() override {}
+    };
+
+    std::unique_ptr<SpaceWatcher::FileEvent> makeEvent(SpaceWatcher::FileAction action,
+                                                       const std::string &path, const std::string &parent) {
+        std::unique_ptr<SpaceWatcher::FileEvent> event(new SpaceWatcher::FileEvent());
+        event->action = action;
+        event->filepath = path;
+        event->parentpath = parent;
+        return event;
+    }
+}
+
+TEST_CASE("SpaceWatcher reports lost events", "[watcher]")
+{
+    ManualWatcher watcher;
+    watcher.setCoalescing(true);
+    REQUIRE(watcher.getLostEventsCount() == 0);
+
+    watcher.addEvent(makeEvent(SpaceWatcher::FileAction::ADDED, "/root/a", "/root/"));
+    watcher.reportLostEvents("/root/");
+    watcher.addEvent(makeEvent(SpaceWatcher::FileAction::REMOVED, "/root/b", "/root/"));
+    REQUIRE(watcher.getLostEventsCount() == 1);
+
+    // lost events can't be replaced by any other event
+    auto ev = watcher.popEvent();
+    REQUIRE(ev != nullptr);
+    REQUIRE(ev->action == SpaceWatcher::FileAction::EVENTS_LOST);
+    REQUIRE(ev->parentpath == "/root/");
+    REQUIRE(watcher.popEvent() == nullptr);
+}
+
+TEST_CASE("SpaceWatcher watches whole filesystem", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+    dh.createDir("test");
+
+    // falls back to regular watcher if there are not enough permissions
+    auto watcher = SpaceWatcher::create(root.getPath(), true);
+    REQUIRE(watcher != nullptr);
+    if (!watcher->isRecursive())
+        return;
+
+    // subdirectory is not added explicitly
+    dh.createFile("test/test.txt");
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+    auto ev = watcher->popEvent();
+    REQUIRE(ev != nullptr);
+    root.addDir("test");
+    REQUIRE(ev->parentpath == root.getPath());
+    root.addFile("test.txt");
+    REQUIRE(ev->filepath == root.getPath());
+    REQUIRE(ev->action == SpaceWatcher::FileAction::ADDED);
+    REQUIRE(watcher->popEvent() == nullptr);
+}
+
+TEST_CASE("SpaceWatcher removes watched directories", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+    dh.createDir("test");
+    dh.createDir("test/inner");
+    dh.createDir("test2");
+
+    auto watcher = SpaceWatcher::create(root.getPath());
+    if (watcher->getDirCountLimit() < 0)
+        return; // watched directories are not counted
+
+    auto path = root;
+    path.addDir("test");
+    watcher->addDir(path.getPath());
+    path.addDir("inner");
+    watcher->addDir(path.getPath());
+    path = root;
+    path.addDir("test2");
+    watcher->addDir(path.getPath());
+    REQUIRE(watcher->getWatchedDirCount() == 4);
+
+    // directory is removed together with its subdirectories, but not with similarly named ones
+    path = root;
+    path.addDir("test");
+    watcher->rmDir(path.getPath());
+    REQUIRE(watcher->getWatchedDirCount() == 2);
+
+    dh.createFile("test/test.txt");
+    dh.createFile("test2/test.txt");
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+    auto ev = watcher->popEvent();
+    REQUIRE(ev != nullptr);
+    path = root;
+    path.addDir("test2");
+    REQUIRE(ev->parentpath == path.getPath());
+    REQUIRE(watcher->popEvent() == nullptr);
+}
+
+TEST_CASE("SpaceWatcher limits are cached", "[watcher]")
+{
+    FilePath root("TestDir");
+    DirHelper dh(root.getPath());
+
+    auto watcher = SpaceWatcher::create(root.getPath());
+    auto limit = watcher->getDirCountLimit();
+    if (limit < 0)
+        return; // there is no limit
+
+    REQUIRE(limit > 0);
+    // watches of user are counted only when limit is reached
+    REQUIRE(watcher->getUserWatchCount() == -1);
+
+    // limit is not read from system each time
+    auto start = std::chrono::steady_clock::now();
+    bool sameLimit = true;
+    for (int i = 0; i < 100000; ++i)
+        sameLimit = sameLimit && watcher->getDirCountLimit() == limit;
+    REQUIRE(sameLimit);
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+}
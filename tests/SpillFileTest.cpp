@@ -0,0 +1,97 @@
+#include "SpillFile.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+TEST_CASE("SpillFile", "[spill]")
+{
+    const std::string path = "TestSpillFile.bin";
+
+    SECTION("Written data can be read back")
+    {
+        SpillFile file(path);
+        std::string first = "first block";
+        std::string second = "second";
+        REQUIRE(file.write(first.data(), first.size()) == 0);
+        REQUIRE(file.write(second.data(), second.size()) == first.size());
+        REQUIRE(file.size() == first.size() + second.size());
+
+        std::string data(second.size(), '\0');
+        REQUIRE(file.read(first.size(), &data[0], data.size()));
+        REQUIRE(data == second);
+
+        // data written after file was mapped is read too
+        std::string third = "third";
+        auto offset = file.write(third.data(), third.size());
+        data.resize(third.size());
+        REQUIRE(file.read(offset, &data[0], data.size()));
+        REQUIRE(data == third);
+
+        REQUIRE_FALSE(file.read(offset, &data[0], data.size() + 1));
+
+        // data can be accessed in mapping without copying it
+        std::string viewed;
+        REQUIRE(file.view(first.size(), second.size(), [&viewed, &second](const char *block) {
+            viewed.assign(block, second.size());
+        }));
+        REQUIRE(viewed == second);
+        REQUIRE_FALSE(file.view(offset, third.size() + 1, [](const char *) {}));
+    }
+
+    SECTION("Released space is reused")
+    {
+        SpillFile file(path);
+        std::string first(100, 'a');
+        std::string second(50, 'b');
+        std::string third(30, 'c');
+        REQUIRE(file.write(first.data(), first.size()) == 0);
+        REQUIRE(file.write(second.data(), second.size()) == 100);
+        REQUIRE(file.write(third.data(), third.size()) == 150);
+
+        std::string data(first.size(), '\0');
+        REQUIRE(file.read(0, &data[0], data.size()));
+
+        file.release(0, first.size());
+        file.release(150, third.size());
+        REQUIRE(file.releasedSize() == 130);
+
+        // the smallest range that fits is used
+        std::string fourth(20, 'd');
+        REQUIRE(file.write(fourth.data(), fourth.size()) == 150);
+        REQUIRE(file.releasedSize() == 110);
+        // data that is already mapped is overwritten too
+        std::string fifth(60, 'e');
+        REQUIRE(file.write(fifth.data(), fifth.size()) == 0);
+        REQUIRE(file.size() == 180);
+
+        data.resize(fifth.size());
+        REQUIRE(file.read(0, &data[0], data.size()));
+        REQUIRE(data == fifth);
+        data.resize(fourth.size());
+        REQUIRE(file.read(150, &data[0], data.size()));
+        REQUIRE(data == fourth);
+
+        // neighbour ranges are merged, so bigger block fits into them
+        file.release(0, fifth.size());
+        file.release(100, second.size());
+        std::string sixth(150, 'f');
+        REQUIRE(file.write(sixth.data(), sixth.size()) == 0);
+        REQUIRE(file.size() == 180);
+        REQUIRE(file.releasedSize() == 10);
+        data.resize(sixth.size());
+        REQUIRE(file.read(0, &data[0], data.size()));
+        REQUIRE(data == sixth);
+    }
+
+    SECTION("File is removed when spill file is destroyed")
+    {
+        {
+            SpillFile file(path);
+            REQUIRE(std::ifstream(path).good());
+        }
+        REQUIRE_FALSE(std::ifstream(path).good());
+    }
+}